@@ -0,0 +1,111 @@
+/*
+ * Microbenchmark of skipping unwanted data in incoming packets.
+ *
+ * Payloads of messages nobody is interested in (and will messages, which the
+ * broker doesn't support) are discarded with IncomingPacket::ignore().  This
+ * sketch measures how many bytes per second it can skip, compared to reading
+ * the data byte by byte, which is what ignore() used to do.  The data is
+ * served from memory, in chunks the size of a TCP segment, so only the
+ * overhead of the library and the Client interface is measured.
+ *
+ * Flash it to the board and check the results on the serial console.
+ */
+
+#include <Arduino.h>
+#include <PicoMQTT.h>
+
+class MemoryClient : public ::Client {
+public:
+    MemoryClient() : remaining(0) {}
+
+    void reset(size_t size) { remaining = size; }
+
+    virtual int connect(IPAddress ip, uint16_t port) override { return 0; }
+    virtual int connect(const char * host, uint16_t port) override {
+        return 0;
+    }
+#ifdef PICOMQTT_EXTRA_CONNECT_METHODS
+    virtual int connect(IPAddress ip, uint16_t port,
+                        int32_t timeout) override {
+        return 0;
+    }
+    virtual int connect(const char * host, uint16_t port,
+                        int32_t timeout) override {
+        return 0;
+    }
+#endif
+    virtual size_t write(uint8_t value) override { return 1; }
+    virtual size_t write(const uint8_t * buf, size_t size) override {
+        return size;
+    }
+    virtual void flush() override {}
+    virtual void stop() override { remaining = 0; }
+    virtual uint8_t connected() override { return remaining > 0; }
+    virtual operator bool() override { return remaining > 0; }
+
+    // pretend data arrives in TCP segments
+    virtual int available() override {
+        return remaining < segment_size ? remaining : segment_size;
+    }
+
+    virtual int read() override {
+        if (!remaining) {
+            return -1;
+        }
+        --remaining;
+        return 'x';
+    }
+
+    virtual int read(uint8_t * buf, size_t size) override {
+        const size_t ret = size < (size_t)available() ? size : available();
+        memset(buf, 'x', ret);
+        remaining -= ret;
+        return ret;
+    }
+
+    virtual int peek() override { return remaining ? 'x' : -1; }
+
+protected:
+    static const size_t segment_size = 1436;
+    size_t remaining;
+};
+
+MemoryClient memory_client;
+PicoMQTT::ClientWrapper client(memory_client, 1000);
+
+template <typename Function>
+float measure(size_t payload_size, Function function) {
+    const unsigned int repeat = 50;
+    const unsigned long start = micros();
+    for (unsigned int i = 0; i < repeat; ++i) {
+        memory_client.reset(payload_size);
+        PicoMQTT::IncomingPacket packet(PicoMQTT::Packet::PUBLISH, 0,
+                                        payload_size, client);
+        function(packet, payload_size);
+    }
+    const unsigned long elapsed = micros() - start;
+    return 1000000.0 * payload_size * repeat / (elapsed ? elapsed : 1);
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    for (size_t size : {256, 1024, 10240}) {
+        const float bytewise =
+            measure(size, [](PicoMQTT::IncomingPacket & packet, size_t size) {
+                for (size_t i = 0; i < size; ++i) {
+                    packet.read();
+                }
+            });
+        const float chunked =
+            measure(size, [](PicoMQTT::IncomingPacket & packet, size_t size) {
+                packet.ignore(size);
+            });
+        Serial.printf(
+            "%5u bytes: byte by byte %9.0f B/s, ignore() %9.0f B/s (%.1fx)\n",
+            (unsigned int)size, bytewise, chunked, chunked / bytewise);
+    }
+}
+
+void loop() {}
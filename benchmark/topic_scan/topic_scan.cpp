@@ -0,0 +1,218 @@
+/*
+ * Host microbenchmark of topic matching and topic filter validation.
+ *
+ * Compares the byte at a time implementations (used on the microcontrollers)
+ * with the ones built on the scanners from topic_scan.h, on topics 64 to 256
+ * bytes long.
+ *
+ * It lives in its own folder, so Arduino tools don't compile it into the
+ * benchmark sketch.  Build from the repository root and run:
+ *   g++ -O2 -std=c++11 -Isrc benchmark/topic_scan/topic_scan.cpp \
+ *       -o topic_scan
+ *   ./topic_scan
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "PicoMQTT/topic_scan.h"
+
+using namespace PicoMQTT;
+
+// Byte at a time implementations, same as in subscriber.cpp
+namespace reference {
+
+bool topic_matches(const char * p, const char * t) {
+    while (true) {
+        if (*p == '#') {
+            return true;
+        }
+        if (*p == '\0') {
+            return *t == '\0';
+        }
+        if (*p == '+') {
+            while (*t && *t != '/') {
+                ++t;
+            }
+            ++p;
+            continue;
+        }
+        if (*t == '\0') {
+            return p[0] == '/' && p[1] == '#' && p[2] == '\0';
+        }
+        if (*p != *t) {
+            return false;
+        }
+        ++p;
+        ++t;
+    }
+}
+
+bool is_valid_topic_filter(const char * topic_filter) {
+    if (!topic_filter || topic_filter[0] == '\0') {
+        return false;
+    }
+    enum class State { segment_start, segment_cont, separator, end } state =
+        State::segment_start;
+    for (;; ++topic_filter) {
+        const char c = *topic_filter;
+        switch (state) {
+            case State::segment_start:
+                if (c == '+') {
+                    state = State::separator;
+                } else if (c == '#') {
+                    state = State::end;
+                } else if (c == '\0') {
+                    return true;
+                } else if (c != '/') {
+                    state = State::segment_cont;
+                }
+                break;
+            case State::segment_cont:
+                if (c == '/') {
+                    state = State::segment_start;
+                } else if (c == '\0') {
+                    return true;
+                } else if (c == '+' || c == '#') {
+                    return false;
+                }
+                break;
+            case State::separator:
+                if (c == '/') {
+                    state = State::segment_start;
+                } else if (c == '\0') {
+                    return true;
+                } else {
+                    return false;
+                }
+                break;
+            case State::end:
+                return c == '\0';
+        }
+    }
+}
+
+}  // namespace reference
+
+struct Case {
+    std::string filter;
+    std::string topic;
+};
+
+static std::string make_topic(size_t size, size_t level_size, unsigned seed) {
+    std::string ret;
+    while (ret.size() < size) {
+        if (!ret.empty()) {
+            ret += '/';
+        }
+        for (size_t i = 0; i < level_size && ret.size() < size; ++i) {
+            ret += 'a' + (seed++ * 7) % 26;
+        }
+    }
+    return ret;
+}
+
+static std::vector<Case> make_cases(size_t size) {
+    std::vector<Case> ret;
+    for (unsigned i = 0; i < 64; ++i) {
+        const std::string topic = make_topic(size, 6 + i % 11, i);
+
+        // exact match, mismatch on the last character and wildcards
+        std::string mismatch = topic;
+        mismatch.back() = (mismatch.back() == 'x') ? 'y' : 'x';
+        std::string plus = topic;
+        plus.replace(0, plus.find('/'), "+");
+        std::string hash = topic.substr(0, topic.rfind('/')) + "/#";
+
+        ret.push_back({topic, topic});
+        ret.push_back({mismatch, topic});
+        ret.push_back({plus, topic});
+        ret.push_back({hash, topic});
+    }
+    return ret;
+}
+
+// results of the measured calls end up here, so they can't be optimized out
+static volatile size_t checksum;
+
+template <typename Function>
+static double measure(const std::vector<Case> & cases, Function function) {
+    const size_t repeat = 20000;
+    size_t sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repeat; ++r) {
+        for (const Case & c : cases) {
+            sum += function(c);
+        }
+        // keep the compiler from hoisting the calls out of the loop
+        asm volatile("" : : : "memory");
+    }
+    const auto end = std::chrono::steady_clock::now();
+    checksum += sum;
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+           (repeat * cases.size());
+}
+
+template <typename Scanner>
+static void run(const char * name, const std::vector<Case> & cases,
+                double reference_match, double reference_valid) {
+    for (const Case & c : cases) {
+        const auto ignore = [](const char *, size_t) {};
+        if ((scan_topic_matches<Scanner>(c.filter.c_str(), c.topic.c_str(),
+                                         ignore) !=
+             reference::topic_matches(c.filter.c_str(), c.topic.c_str())) ||
+            (scan_is_valid_topic_filter<Scanner>(c.filter.c_str()) !=
+             reference::is_valid_topic_filter(c.filter.c_str()))) {
+            printf("%s: result mismatch for %s\n", name, c.filter.c_str());
+        }
+    }
+
+    const double match = measure(
+        cases,
+        [](const Case & c) {
+            return scan_topic_matches<Scanner>(c.filter.c_str(),
+                                               c.topic.c_str(),
+                                               [](const char *, size_t) {});
+        });
+    const double valid = measure(
+        cases,
+        [](const Case & c) {
+            return scan_is_valid_topic_filter<Scanner>(c.filter.c_str());
+        });
+
+    printf("  %-10s match %7.1f ns (%4.2fx)   validate %7.1f ns (%4.2fx)\n",
+           name, match, reference_match / match, valid,
+           reference_valid / valid);
+}
+
+int main() {
+    for (size_t size : {64, 128, 256}) {
+        const std::vector<Case> cases = make_cases(size);
+
+        const double match = measure(
+            cases,
+            [](const Case & c) {
+                return reference::topic_matches(c.filter.c_str(),
+                                                c.topic.c_str());
+            });
+        const double valid = measure(
+            cases,
+            [](const Case & c) {
+                return reference::is_valid_topic_filter(c.filter.c_str());
+            });
+
+        printf("%zu byte topics\n", size);
+        printf("  %-10s match %7.1f ns          validate %7.1f ns\n",
+               "bytewise", match, valid);
+        run<ScalarTopicScanner>("scalar", cases, match, valid);
+#if defined(PICOMQTT_SWAR_TOPIC_SCANNER)
+        run<SwarTopicScanner>("swar", cases, match, valid);
+#endif
+#if defined(__SSE2__)
+        run<Sse2TopicScanner>("sse2", cases, match, valid);
+#endif
+    }
+    return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * Host benchmark of the Linux socket backends: EpollServerSocket (a system
+ * call for every read and write) and UringServerSocket (one io_uring_enter()
+ * per Server::loop() for all connections).
+ *
+ * The broker runs in its own thread, with a number of subscribers and a
+ * single publisher connected over loopback.  The publisher sends a stream of
+ * small messages, which the broker fans out to all subscribers.  The
+ * benchmark reports the delivered messages per second and the system calls
+ * made by the broker's thread.  They are counted by wrapping the socket
+ * related libc functions, so the numbers include every call the library
+ * makes (but not the ones made inside libc itself).
+ *
+ * PicoMQTT needs an Arduino API emulation layer (providing Arduino.h,
+ * Client.h and friends) to build on Linux.  The benchmark lives in its own
+ * folder, so Arduino tools don't compile it into the benchmark sketch.  Build
+ * from the repository root and run:
+ *   g++ -O2 -std=gnu++11 -I<emulation layer> -Isrc \
+ *       benchmark/uring_loopback/uring_loopback.cpp src/PicoMQTT/*.cpp \
+ *       -o uring_loopback -lpthread -ldl
+ *   ./uring_loopback [subscribers] [messages]
+ */
+
+#include <PicoMQTT.h>
+#include <PicoMQTT/posix_socket.h>
+#include <PicoMQTT/uring_socket.h>
+#include <arpa/inet.h>
+#include <dlfcn.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// System call counting
+namespace {
+
+std::atomic<unsigned long> syscall_count(0);
+thread_local bool count_syscalls = false;
+
+void count() {
+    if (count_syscalls) {
+        ++syscall_count;
+    }
+}
+
+template <typename Function>
+Function real(const char * name) {
+    return (Function)dlsym(RTLD_NEXT, name);
+}
+
+}  // namespace
+
+extern "C" {
+
+ssize_t send(int fd, const void * buf, size_t len, int flags) {
+    static auto f = real<ssize_t (*)(int, const void *, size_t, int)>("send");
+    count();
+    return f(fd, buf, len, flags);
+}
+
+ssize_t recv(int fd, void * buf, size_t len, int flags) {
+    static auto f = real<ssize_t (*)(int, void *, size_t, int)>("recv");
+    count();
+    return f(fd, buf, len, flags);
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+    static auto f = real<int (*)(int, unsigned long, void *)>("ioctl");
+    va_list args;
+    va_start(args, request);
+    void * arg = va_arg(args, void *);
+    va_end(args);
+    count();
+    return f(fd, request, arg);
+}
+
+int poll(struct pollfd * fds, nfds_t nfds, int timeout) {
+    static auto f = real<int (*)(struct pollfd *, nfds_t, int)>("poll");
+    count();
+    return f(fds, nfds, timeout);
+}
+
+int epoll_wait(int epfd, struct epoll_event * events, int maxevents,
+               int timeout) {
+    static auto f =
+        real<int (*)(int, struct epoll_event *, int, int)>("epoll_wait");
+    count();
+    return f(epfd, events, maxevents, timeout);
+}
+
+long syscall(long number, ...) {
+    static auto f = real<long (*)(long, long, long, long, long, long, long)>(
+        "syscall");
+    va_list args;
+    va_start(args, number);
+    long a[6];
+    for (int i = 0; i < 6; ++i) {
+        a[i] = va_arg(args, long);
+    }
+    va_end(args);
+    count();
+    return f(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+}
+
+// MQTT packets
+namespace {
+
+std::string encode_string(const std::string & s) {
+    return std::string(1, char(s.size() >> 8)) + char(s.size() & 0xff) + s;
+}
+
+std::string encode_packet(uint8_t head, const std::string & content) {
+    std::string ret(1, char(head));
+    size_t size = content.size();
+    do {
+        const uint8_t digit = size & 0x7f;
+        size >>= 7;
+        ret += char(digit | (size ? 0x80 : 0));
+    } while (size);
+    return ret + content;
+}
+
+std::string connect_packet(const std::string & client_id) {
+    return encode_packet(0x10, encode_string("MQTT") + char(4) + char(2) +
+                                   char(0) + char(60) +
+                                   encode_string(client_id));
+}
+
+std::string subscribe_packet(const std::string & topic_filter) {
+    return encode_packet(0x82, std::string("\0\1", 2) +
+                                   encode_string(topic_filter) + char(0));
+}
+
+std::string publish_packet(const std::string & topic,
+                           const std::string & payload) {
+    return encode_packet(0x30, encode_string(topic) + payload);
+}
+
+int dial(uint16_t port) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void send_all(int fd, const std::string & data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t ret = send(fd, data.data() + sent, data.size() - sent,
+                                 MSG_NOSIGNAL);
+        if (ret <= 0) {
+            return;
+        }
+        sent += ret;
+    }
+}
+
+bool receive_all(int fd, size_t size) {
+    char buffer[4096];
+    while (size) {
+        const ssize_t ret =
+            recv(fd, buffer, size < sizeof(buffer) ? size : sizeof(buffer), 0);
+        if (ret <= 0) {
+            return false;
+        }
+        size -= ret;
+    }
+    return true;
+}
+
+}  // namespace
+
+void run(const char * name, PicoMQTT::ServerSocketInterface * socket,
+         uint16_t port, unsigned int subscribers, unsigned int messages) {
+    std::unique_ptr<PicoMQTT::ServerSocketInterface> socket_ptr(socket);
+    PicoMQTT::Server server(std::move(socket_ptr));
+    server.accept_burst = 64;
+    server.max_pending_clients = subscribers + 1;
+    server.begin();
+
+    std::atomic<bool> stop(false);
+    std::atomic<bool> measure(false);
+    std::atomic<unsigned long> loops(0);
+    std::thread broker([&] {
+        while (!stop) {
+            count_syscalls = measure;
+            server.loop();
+            if (measure) {
+                ++loops;
+            }
+        }
+    });
+
+    // connect and subscribe, CONNACK and SUBACK are 4 and 5 bytes long
+    std::vector<int> fds;
+    for (unsigned int i = 0; i <= subscribers; ++i) {
+        const int fd = dial(port);
+        if (fd < 0) {
+            printf("%s: connection failed\n", name);
+            break;
+        }
+        send_all(fd, connect_packet("client" + std::to_string(i)));
+        if (!receive_all(fd, 4)) {
+            printf("%s: connection refused\n", name);
+            break;
+        }
+        fds.push_back(fd);
+    }
+
+    const int publisher = fds.empty() ? -1 : fds.back();
+    if (fds.size() == subscribers + 1) {
+        fds.pop_back();
+        for (int fd : fds) {
+            send_all(fd, subscribe_packet("bench/#"));
+            receive_all(fd, 5);
+        }
+    } else {
+        fds.clear();
+    }
+
+    if (!fds.empty()) {
+        const std::string packet =
+            publish_packet("bench/data", std::string(64, 'x'));
+
+        std::string batch;
+        for (unsigned int i = 0; i < messages; ++i) {
+            batch += packet;
+        }
+
+        syscall_count = 0;
+        measure = true;
+        const auto start = std::chrono::steady_clock::now();
+
+        std::thread publisher_thread([&] { send_all(publisher, batch); });
+
+        // read the same amount of data from all subscribers in parallel
+        const int epoll_fd = epoll_create1(0);
+        for (size_t i = 0; i < fds.size(); ++i) {
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i], &event);
+        }
+
+        std::vector<size_t> remaining(fds.size(), batch.size());
+        size_t incomplete = fds.size();
+        char buffer[16384];
+        while (incomplete) {
+            epoll_event events[64];
+            const int count = epoll_wait(epoll_fd, events, 64, 5000);
+            if (count <= 0) {
+                printf("%s: timed out\n", name);
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                const size_t idx = events[i].data.u64;
+                const ssize_t ret =
+                    recv(fds[idx], buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (ret <= 0) {
+                    continue;
+                }
+                remaining[idx] -= (size_t)ret < remaining[idx]
+                                      ? (size_t)ret
+                                      : remaining[idx];
+                if (!remaining[idx]) {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fds[idx], nullptr);
+                    --incomplete;
+                }
+            }
+        }
+        close(epoll_fd);
+
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        measure = false;
+        publisher_thread.join();
+
+        const double seconds = std::chrono::duration<double>(elapsed).count();
+        const unsigned long delivered =
+            (unsigned long)(fds.size() - incomplete) * messages;
+        const unsigned long calls = syscall_count;
+        printf("%-6s %8.3f s %12.0f msgs/s %10lu syscalls %8.3f per msg "
+               "%10lu loops\n",
+               name, seconds, delivered / seconds, calls,
+               delivered ? (double)calls / delivered : 0.0,
+               (unsigned long)loops);
+    }
+
+    for (int fd : fds) {
+        close(fd);
+    }
+    if (publisher >= 0) {
+        close(publisher);
+    }
+
+    stop = true;
+    broker.join();
+}
+
+int main(int argc, char ** argv) {
+    const unsigned int subscribers = argc > 1 ? atoi(argv[1]) : 100;
+    const unsigned int messages = argc > 2 ? atoi(argv[2]) : 10000;
+
+    printf("%u subscribers, %u messages of 64 bytes each\n", subscribers,
+           messages);
+
+    run("epoll", new PicoMQTT::EpollServerSocket(18830, "127.0.0.1"), 18830,
+        subscribers, messages);
+    run("uring",
+        new PicoMQTT::UringServerSocket(18831, "127.0.0.1", subscribers + 1),
+        18831, subscribers, messages);
+
+    return 0;
+}
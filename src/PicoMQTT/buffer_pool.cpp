@@ -0,0 +1,55 @@
+#include "buffer_pool.h"
+
+#include "debug.h"
+
+namespace PicoMQTT {
+
+BufferPool::~BufferPool() {
+    TRACE_FUNCTION;
+    if (!block_in_use) {
+        free(block);
+    }
+}
+
+uint8_t * BufferPool::acquire() {
+    TRACE_FUNCTION;
+    if (!block_size) {
+        return nullptr;
+    }
+
+    if (block_in_use) {
+        return (uint8_t *)malloc(block_size);
+    }
+
+    if (!block) {
+        block = (uint8_t *)malloc(block_size);
+    }
+    block_in_use = (block != nullptr);
+    return block;
+}
+
+void BufferPool::release(uint8_t * ptr) {
+    TRACE_FUNCTION;
+    if (ptr && (ptr == block)) {
+        block_in_use = false;
+    } else {
+        free(ptr);
+    }
+}
+
+void BufferPool::set_block_size(size_t size) {
+    TRACE_FUNCTION;
+    if (size == block_size) {
+        return;
+    }
+
+    // a block in use is freed when it's released
+    if (!block_in_use) {
+        free(block);
+    }
+    block = nullptr;
+    block_in_use = false;
+    block_size = size;
+}
+
+}  // namespace PicoMQTT
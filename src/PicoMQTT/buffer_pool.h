@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace PicoMQTT {
+
+/*
+ * Hands out fixed size memory blocks, e.g. for assembling outgoing packets.
+ * One block is kept and reused, so a connection which builds its packets one
+ * at a time doesn't allocate memory for each of them.  Extra blocks (needed
+ * if more blocks are used at the same time) are allocated on demand and
+ * freed when released.
+ */
+class BufferPool {
+public:
+    BufferPool(size_t block_size)
+        : block_size(block_size), block(nullptr), block_in_use(false) {}
+    ~BufferPool();
+
+    BufferPool(const BufferPool &) = delete;
+    const BufferPool & operator=(const BufferPool &) = delete;
+
+    // Returns a block of get_block_size() bytes.  Returns null if the block
+    // size is 0 or if the allocation fails.
+    uint8_t * acquire();
+    void release(uint8_t * block);
+
+    size_t get_block_size() const { return block_size; }
+
+    // Changes the size of blocks returned by subsequent acquire() calls.
+    void set_block_size(size_t size);
+
+protected:
+    size_t block_size;
+    uint8_t * block;
+    bool block_in_use;
+};
+
+}  // namespace PicoMQTT
@@ -32,6 +32,7 @@ bool BasicClient::connect(const char * host, uint16_t port, const char * id,
     }
 
     client.stop();
+    parser.reset();
 
     if (!client.connect(host, port)) {
         return false;
@@ -130,7 +131,26 @@ Publisher::Publish BasicClient::begin_publish(const char * topic,
     Print & print = client.connected() ? (Print &)client : (Print &)dummy_print;
 
     return Publish(
-        *this, print, topic, payload_size, (qos >= 1) ? 1 : 0, retain,
+        *this, print, buffer_pool, topic, payload_size, (qos >= 1) ? 1 : 0,
+        retain,
+        message_id,  // dup if message_id is non-zero
+        message_id ? message_id
+                   : message_id_generator
+                         .generate()  // generate only if message_id == 0
+    );
+}
+
+Publisher::Publish BasicClient::begin_publish(const TopicHandle & topic,
+                                              const size_t payload_size,
+                                              uint8_t qos, bool retain,
+                                              uint16_t message_id) {
+    TRACE_FUNCTION;
+
+    Print & print = client.connected() ? (Print &)client : (Print &)dummy_print;
+
+    return Publish(
+        *this, print, buffer_pool, topic, payload_size, (qos >= 1) ? 1 : 0,
+        retain,
         message_id,  // dup if message_id is non-zero
         message_id ? message_id
                    : message_id_generator
@@ -235,8 +255,8 @@ Client::Client(ClientSocketInterface * socket, const char * host, uint16_t port,
 Client::SubscriptionId Client::subscribe(const String & topic_filter,
                                          MessageCallback callback) {
     TRACE_FUNCTION;
-    const auto ret =
-        SubscribedMessageListener::subscribe(topic_filter, callback);
+    const auto ret = SubscribedMessageListener::subscribe(topic_filter,
+                                                          std::move(callback));
     if (ret) {
         BasicClient::subscribe(topic_filter);
     }
@@ -2,10 +2,15 @@
 
 #include <Arduino.h>
 
+#if defined(ESP32) || defined(ESP8266)
+#include <WiFiClient.h>
+#endif
+
 #include "connection.h"
 #include "incoming_packet.h"
 #include "outgoing_packet.h"
 #include "pico_interface.h"
+#include "posix_socket.h"
 #include "publisher.h"
 #include "subscriber.h"
 #include "utils.h"
@@ -31,6 +36,10 @@ public:
     virtual Publish begin_publish(const char * topic, const size_t payload_size,
                                   uint8_t qos = 0, bool retain = false,
                                   uint16_t message_id = 0) override;
+    virtual Publish begin_publish(const TopicHandle & topic,
+                                  const size_t payload_size, uint8_t qos = 0,
+                                  bool retain = false,
+                                  uint16_t message_id = 0) override;
 
     bool subscribe(const String & topic, uint8_t qos = 0,
                    uint8_t * qos_granted = nullptr);
@@ -74,9 +83,15 @@ public:
            unsigned long reconnect_interval_millis = 5 * 1000,
            unsigned long keep_alive_millis = 60 * 1000,
            unsigned long socket_timeout_millis = 10 * 1000)
+#if defined(ESP32) || defined(ESP8266)
         : Client(new ClientSocket<::WiFiClient>(), host, port, id, user,
                  password, reconnect_interval_millis, keep_alive_millis,
                  socket_timeout_millis) {}
+#else
+        : Client(new ClientSocket<PosixClient>(), host, port, id, user,
+                 password, reconnect_interval_millis, keep_alive_millis,
+                 socket_timeout_millis) {}
+#endif
 
     template <typename ClientType>
     Client(ClientType & client, const char * host = nullptr,
@@ -7,13 +7,37 @@ namespace PicoMQTT {
 
 ClientWrapper::ClientWrapper(::Client & client,
                              unsigned long socket_timeout_millis)
-    : socket_timeout_millis(socket_timeout_millis), client(client) {
+    : socket_timeout_millis(socket_timeout_millis),
+      client(client),
+      queued_since_millis(0),
+      write_space_known(false),
+      conflation(false),
+      receive_begin(0),
+      receive_end(0) {
     TRACE_FUNCTION;
 }
 
 void ClientWrapper::abort() {
     TRACE_FUNCTION;
-    stop();
+    queue.clear();
+    receive_begin = receive_end = 0;
+    client.stop();
+}
+
+void ClientWrapper::set_queue_size(size_t max_size, size_t max_length) {
+    TRACE_FUNCTION;
+    queue.reserve(max_size, max_length);
+}
+
+unsigned long ClientWrapper::get_queued_millis() const {
+    TRACE_FUNCTION;
+    return queue.empty() ? 0 : millis() - queued_since_millis;
+}
+
+void ClientWrapper::on_dropped(size_t size) {
+    TRACE_FUNCTION;
+    ++statistics.dropped_packets;
+    statistics.dropped_bytes += size;
 }
 
 // reads
@@ -38,10 +62,40 @@ int ClientWrapper::available_wait(unsigned long timeout) {
     }
 }
 
+size_t ClientWrapper::read_buffered(uint8_t * buf, size_t size) {
+    TRACE_FUNCTION;
+    const size_t buffered_size = get_buffered_size();
+    const size_t ret = size < buffered_size ? size : buffered_size;
+    memcpy(buf, receive_buffer + receive_begin, ret);
+    receive_begin += ret;
+    return ret;
+}
+
+bool ClientWrapper::fill_buffer() {
+    TRACE_FUNCTION;
+    // only call when the buffer is empty and the socket has data available
+    const int available_size = client.available();
+    if (available_size <= 0) {
+        return false;
+    }
+
+    const size_t size = (size_t)available_size < sizeof(receive_buffer)
+                            ? (size_t)available_size
+                            : sizeof(receive_buffer);
+    const int bytes_read = client.read(receive_buffer, size);
+    if (bytes_read <= 0) {
+        return false;
+    }
+
+    receive_begin = 0;
+    receive_end = bytes_read;
+    return true;
+}
+
 int ClientWrapper::read(uint8_t * buf, size_t size) {
     TRACE_FUNCTION;
     const unsigned long start_millis = millis();
-    size_t ret = 0;
+    size_t ret = read_buffered(buf, size);
 
     while (ret < size) {
         const unsigned long now_millis = millis();
@@ -63,6 +117,19 @@ int ClientWrapper::read(uint8_t * buf, size_t size) {
             break;
         }
 
+        if (PICOMQTT_RECEIVE_BUFFER_SIZE &&
+            (size - ret < (size_t)available_size) &&
+            (size - ret < sizeof(receive_buffer))) {
+            // small read, read ahead the rest of what's available
+            if (!fill_buffer()) {
+                // connection error
+                abort();
+                break;
+            }
+            ret += read_buffered(buf + ret, size - ret);
+            continue;
+        }
+
         const int chunk_size = size - ret < (size_t)available_size
                                    ? size - ret
                                    : (size_t)available_size;
@@ -82,14 +149,25 @@ int ClientWrapper::read(uint8_t * buf, size_t size) {
 
 int ClientWrapper::read() {
     TRACE_FUNCTION;
-    if (!available_wait(socket_timeout_millis)) {
-        return -1;
+    if (!get_buffered_size()) {
+        if (!available_wait(socket_timeout_millis)) {
+            return -1;
+        }
+        if (!PICOMQTT_RECEIVE_BUFFER_SIZE) {
+            return client.read();
+        }
+        if (!fill_buffer()) {
+            return -1;
+        }
     }
-    return client.read();
+    return receive_buffer[receive_begin++];
 }
 
 int ClientWrapper::peek() {
     TRACE_FUNCTION;
+    if (get_buffered_size()) {
+        return receive_buffer[receive_begin];
+    }
     if (!available_wait(socket_timeout_millis)) {
         return -1;
     }
@@ -97,22 +175,24 @@ int ClientWrapper::peek() {
 }
 
 // writes
-size_t ClientWrapper::write(const uint8_t * buffer, size_t size) {
+size_t ClientWrapper::write_blocking(const uint8_t * buffer, size_t size) {
     TRACE_FUNCTION;
+    const unsigned long start_millis = millis();
     size_t ret = 0;
 
     while (connected() && ret < size) {
         const int bytes_written = client.write(buffer + ret, size - ret);
         if (bytes_written <= 0) {
             // connection error
-            abort();
-            return 0;
+            break;
         }
 
         ret += bytes_written;
         yield();
     }
 
+    statistics.blocked_millis += millis() - start_millis;
+
     if (ret != size) {
         abort();
         return 0;
@@ -121,6 +201,155 @@ size_t ClientWrapper::write(const uint8_t * buffer, size_t size) {
     return ret;
 }
 
+size_t ClientWrapper::write_nonblocking(const uint8_t * buffer, size_t size) {
+    TRACE_FUNCTION;
+    const int space = client.availableForWrite();
+    if (space <= 0) {
+        if (write_space_known) {
+            // send buffer full
+            return 0;
+        }
+        // The client doesn't report free space (not all implementations do),
+        // there's no way to avoid blocking.
+        return write_blocking(buffer, size);
+    }
+
+    write_space_known = true;
+    const size_t chunk_size = size < (size_t)space ? size : (size_t)space;
+    const int bytes_written = client.write(buffer, chunk_size);
+    if (bytes_written <= 0) {
+        // connection error
+        abort();
+        return 0;
+    }
+
+    return bytes_written;
+}
+
+bool ClientWrapper::write_queue() {
+    TRACE_FUNCTION;
+    while (!queue.empty()) {
+        const size_t size = queue.front_size();
+        if (write_blocking(queue.front(), size) != size) {
+            return false;
+        }
+        queue.pop(size);
+    }
+    return true;
+}
+
+void ClientWrapper::drain() {
+    TRACE_FUNCTION;
+    while (!queue.empty() && connected()) {
+        const size_t written =
+            write_nonblocking(queue.front(), queue.front_size());
+        if (!written) {
+            break;
+        }
+        queue.pop(written);
+    }
+
+    if (!connected()) {
+        queue.clear();
+    }
+}
+
+size_t ClientWrapper::write(const uint8_t * buffer, size_t size) {
+    TRACE_FUNCTION;
+    if (!queue.get_max_size()) {
+        return write_blocking(buffer, size);
+    }
+
+    // queued data must be sent first
+    const size_t written = queue.empty() ? write_nonblocking(buffer, size) : 0;
+    if ((written == size) || !connected()) {
+        return written;
+    }
+
+    if (queue.empty()) {
+        queued_since_millis = millis();
+    }
+
+    if (!queue.push(buffer + written, size - written)) {
+        // the queue is full, wait until the socket takes everything
+        if (!write_queue() ||
+            (write_blocking(buffer + written, size - written) !=
+             size - written)) {
+            return 0;
+        }
+    }
+
+    return size;
+}
+
+size_t ClientWrapper::write(const SharedBuffer & packet,
+                            OverflowPolicy policy) {
+    TRACE_FUNCTION;
+    if (!queue.get_max_size()) {
+        return write_blocking(packet.data(), packet.size());
+    }
+
+    const size_t written = queue.empty()
+                               ? write_nonblocking(packet.data(), packet.size())
+                               : 0;
+    if ((written == packet.size()) || !connected()) {
+        return written;
+    }
+
+    const size_t remaining = packet.size() - written;
+
+    if (conflation && !written && queue.replace(packet)) {
+        ++statistics.conflated_packets;
+        return packet.size();
+    }
+
+    // Packets which can never fit in the queue are always sent blocking,
+    // and so are packets which were sent partially already.
+    if (!written && (remaining <= queue.get_max_size())) {
+        switch (policy) {
+            case OverflowPolicy::drop_oldest:
+                while (!queue.fits(remaining)) {
+                    const size_t dropped = queue.drop_oldest();
+                    if (!dropped) {
+                        break;
+                    }
+                    on_dropped(dropped);
+                }
+                __attribute__((fallthrough));
+            case OverflowPolicy::drop_newest:
+                if (!queue.fits(remaining)) {
+                    on_dropped(remaining);
+                    return 0;
+                }
+                break;
+            case OverflowPolicy::disconnect:
+                if (!queue.fits(remaining)) {
+                    on_dropped(remaining);
+                    abort();
+                    return 0;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (queue.empty()) {
+        queued_since_millis = millis();
+    }
+
+    if (!queue.push(packet, written)) {
+        // the queue is full, wait until the socket takes everything
+        if (!write_queue() ||
+            (write_blocking(packet.data() + written, remaining) !=
+             remaining)) {
+            return 0;
+        }
+    }
+
+    return packet.size();
+}
+
 size_t ClientWrapper::write(uint8_t value) {
     TRACE_FUNCTION;
     return write(&value, 1);
@@ -153,22 +382,31 @@ int ClientWrapper::connect(const char * host, uint16_t port, int32_t timeout) {
 
 int ClientWrapper::available() {
     TRACE_FUNCTION;
-    return client.available();
+    return get_buffered_size() + client.available();
 }
 
 void ClientWrapper::flush() {
     TRACE_FUNCTION;
+    // send what the socket takes right away, drain() sends the rest later
+    drain();
     client.flush();
 }
 
 void ClientWrapper::stop() {
     TRACE_FUNCTION;
+    // Send whatever queued data the socket takes right away, e.g. a CONNACK
+    // rejecting the connection.  Waiting for the rest could stall the broker
+    // for as long as the socket timeout, so it's dropped.
+    drain();
+    queue.clear();
+    receive_begin = receive_end = 0;
     client.stop();
 }
 
 uint8_t ClientWrapper::connected() {
     TRACE_FUNCTION;
-    return client.connected();
+    // data read ahead can still be consumed after the socket is closed
+    return get_buffered_size() || client.connected();
 }
 
 ClientWrapper::operator bool() { return bool(client); }
@@ -1,11 +1,38 @@
 #pragma once
 
-#include <WiFiClient.h>
+#include <Client.h>
 
 #include "config.h"
+#include "outbound_queue.h"
+#include "shared_buffer.h"
 
 namespace PicoMQTT {
 
+// What to do with a packet which doesn't fit in the outbound queue
+enum class OverflowPolicy {
+    block,        // wait until the socket takes the queued data
+    drop_newest,  // drop the new packet
+    drop_oldest,  // drop queued packets which weren't sent yet
+    disconnect,   // drop the connection
+};
+
+struct OutboundStatistics {
+    OutboundStatistics()
+        : dropped_packets(0),
+          dropped_bytes(0),
+          conflated_packets(0),
+          blocked_millis(0) {}
+
+    unsigned long dropped_packets;
+    unsigned long dropped_bytes;
+
+    // queued messages replaced by newer ones on the same topic
+    unsigned long conflated_packets;
+
+    // time spent waiting in blocking writes
+    unsigned long blocked_millis;
+};
+
 class ClientWrapper : public ::Client {
 public:
     ClientWrapper(::Client & client, unsigned long socket_timeout_millis);
@@ -35,10 +62,61 @@ public:
 
     void abort();
 
+    // The outbound queue is disabled (zero sized) by default, so writes block
+    // until the socket takes all the data.  With the queue enabled, data
+    // which can't be written right away is queued and sent by drain().
+    // Writes only block if the queue is full.
+    void set_queue_size(size_t max_size, size_t max_length);
+    size_t get_queued_size() const { return queue.size(); }
+
+    // Time since the queue was last empty
+    unsigned long get_queued_millis() const;
+
+    // Writes (or queues a reference to) a whole packet.  Only whole packets
+    // can be dropped, other writes always block when the queue is full
+    // (unless the policy is to disconnect).
+    size_t write(const SharedBuffer & packet,
+                 OverflowPolicy policy = OverflowPolicy::block);
+
+    const OutboundStatistics & get_statistics() const { return statistics; }
+
+    // With conflation enabled, a queued QoS 0 message is replaced by a newer
+    // one on the same topic instead of sending both.
+    void set_conflation(bool enable) { conflation = enable; }
+    bool get_conflation() const { return conflation; }
+
+    // Writes as much queued data as the socket can take without blocking.
+    void drain();
+
 protected:
     ::Client & client;
+    OutboundQueue queue;
+
+    OutboundStatistics statistics;
+    unsigned long queued_since_millis;
+
+    // set once the client reports free space in its send buffer
+    bool write_space_known;
+
+    bool conflation;
+
+    // data read ahead from the socket, but not consumed yet
+    uint8_t receive_buffer[PICOMQTT_RECEIVE_BUFFER_SIZE
+                               ? PICOMQTT_RECEIVE_BUFFER_SIZE
+                               : 1];
+    size_t receive_begin;
+    size_t receive_end;
+
+    size_t get_buffered_size() const { return receive_end - receive_begin; }
+    size_t read_buffered(uint8_t * buf, size_t size);
+    bool fill_buffer();
 
     int available_wait(unsigned long timeout);
+
+    size_t write_blocking(const uint8_t * buffer, size_t size);
+    size_t write_nonblocking(const uint8_t * buffer, size_t size);
+    bool write_queue();
+    void on_dropped(size_t size);
 };
 
 }  // namespace PicoMQTT
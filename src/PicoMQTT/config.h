@@ -26,8 +26,120 @@
 #define PICOMQTT_MAX_SUBSCRIPTIONS_PER_PACKET 256
 #endif
 
+#ifndef PICOMQTT_TOPIC_HASH_LEVELS
+// Number of leading topic levels for which prefix hashes are precomputed when
+// matching a topic against subscriptions.  Filters with longer literal
+// prefixes skip the hash check.
+#define PICOMQTT_TOPIC_HASH_LEVELS 8
+#endif
+
+#ifndef PICOMQTT_ROUTING_CACHE_SIZE
+// Number of topics for which the broker caches the list of subscribed
+// clients.  Set to 0 to disable the cache.
+#define PICOMQTT_ROUTING_CACHE_SIZE 32
+#endif
+
+#ifndef PICOMQTT_TOPIC_AUTOMATON_MIN_FILTERS
+// Subscribers (e.g. clients and brokers with local subscriptions) with at
+// least this many wildcard subscriptions compile them into an automaton,
+// which matches topics against all of them at once.  Fewer subscriptions are
+// just checked one by one.  Set to 0 to never build the automaton.
+#define PICOMQTT_TOPIC_AUTOMATON_MIN_FILTERS 16
+#endif
+
+#ifndef PICOMQTT_TOPIC_AUTOMATON_MAX_STATES
+// Maximum number of states of the topic automaton.  Some sets of filters
+// (e.g. many long ones mixing '+' and literal levels) need exponentially many
+// states.  If building the automaton hits this limit, it's abandoned and
+// the subscriptions are checked one by one until they change again.
+#if defined(ESP8266)
+#define PICOMQTT_TOPIC_AUTOMATON_MAX_STATES 256
+#else
+#define PICOMQTT_TOPIC_AUTOMATON_MAX_STATES 4096
+#endif
+#endif
+
+#ifndef PICOMQTT_WIDE_TOPIC_SCAN
+// Match topics and validate topic filters using SSE2 or 64-bit words on
+// targets which support it (i.e. host builds, not the microcontrollers).
+#define PICOMQTT_WIDE_TOPIC_SCAN 1
+#endif
+
+#ifndef PICOMQTT_MAX_FANOUT_BUFFER_SIZE
+// Messages published by the broker are serialized once into a shared buffer,
+// which is then written to each recipient in a single call.  Larger messages,
+// or ones for which the buffer can't be allocated, are streamed to all
+// recipients in PICOMQTT_OUTGOING_BUFFER_SIZE chunks instead.  Set to 0 to
+// always stream.
+#if defined(ESP8266)
+#define PICOMQTT_MAX_FANOUT_BUFFER_SIZE 4096
+#else
+#define PICOMQTT_MAX_FANOUT_BUFFER_SIZE 16384
+#endif
+#endif
+
+#ifndef PICOMQTT_CLIENT_QUEUE_SIZE
+// Maximum number of bytes queued for each client connected to the broker.
+// Data which a client's socket can't take right away is queued and sent from
+// Server::loop() as the socket becomes writable, so a slow client doesn't
+// stall the others.  Writes to a client with a full queue block until all of
+// it is sent.  Set to 0 to always block.  Messages sent to multiple clients
+// are queued by reference, they count towards each client's limit, but they
+// are stored once.
+#if defined(ESP8266)
+#define PICOMQTT_CLIENT_QUEUE_SIZE 4096
+#else
+#define PICOMQTT_CLIENT_QUEUE_SIZE 16384
+#endif
+#endif
+
+#ifndef PICOMQTT_CLIENT_QUEUE_LENGTH
+// Maximum number of separate chunks of data (e.g. messages) queued for each
+// client connected to the broker.
+#define PICOMQTT_CLIENT_QUEUE_LENGTH 32
+#endif
+
 #ifndef PICOMQTT_OUTGOING_BUFFER_SIZE
-#define PICOMQTT_OUTGOING_BUFFER_SIZE 128
+// Default size of the buffers in which outgoing packets are assembled before
+// they're written to the socket.  Matching the TCP maximum segment size of
+// lwIP's default configuration makes every flush fill a whole segment.  Set
+// to 0 to write to the socket directly.  Servers and clients can change it
+// at runtime with set_outgoing_buffer_size().
+#if defined(ESP8266)
+#define PICOMQTT_OUTGOING_BUFFER_SIZE 536
+#else
+#define PICOMQTT_OUTGOING_BUFFER_SIZE 1436
+#endif
+#endif
+
+#ifndef PICOMQTT_STREAMING_THRESHOLD
+// Incoming packets are collected as their data arrives, without blocking, and
+// handled once they're complete.  Packets bigger than this are handled as
+// soon as their first PICOMQTT_STREAMING_THRESHOLD bytes arrive, the rest is
+// read while they're handled, which can block until it arrives.
+#define PICOMQTT_STREAMING_THRESHOLD 1024
+#endif
+
+#ifndef PICOMQTT_RECEIVE_BUFFER_SIZE
+// Size of the buffer in which each connection reads ahead incoming data.
+// Small reads (e.g. packet headers and short packets) are served from it, so
+// a batch of small packets takes a single read from the socket.  Bigger reads
+// bypass it.  Set to 0 to read from the socket directly.
+#define PICOMQTT_RECEIVE_BUFFER_SIZE 256
+#endif
+
+#ifndef PICOMQTT_URING_RECEIVE_BUFFER_SIZE
+// Size of each connection's receive buffer with the Linux io_uring backend
+// (UringServerSocket).  The buffers of all connections are allocated and
+// registered with the kernel when the server starts.
+#define PICOMQTT_URING_RECEIVE_BUFFER_SIZE 4096
+#endif
+
+#ifndef PICOMQTT_URING_SEND_BUFFER_SIZE
+// Size of each connection's send buffer with the Linux io_uring backend.
+// Everything written to a connection during a Server::loop() call is sent
+// with one request, writes block only if the buffer is full.
+#define PICOMQTT_URING_SEND_BUFFER_SIZE 16384
 #endif
 
 #ifdef ESP32
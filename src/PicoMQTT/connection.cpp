@@ -6,8 +6,11 @@
 namespace PicoMQTT {
 
 Connection::Connection(::Client & client, unsigned long keep_alive_millis,
-                       unsigned long socket_timeout_millis)
+                       unsigned long socket_timeout_millis,
+                       size_t outgoing_buffer_size)
     : client(client, socket_timeout_millis),
+      parser(this->client),
+      buffer_pool(outgoing_buffer_size),
       keep_alive_millis(keep_alive_millis),
       last_read(millis()),
       last_write(millis()) {
@@ -18,7 +21,7 @@ OutgoingPacket Connection::build_packet(Packet::Type type, uint8_t flags,
                                         size_t length) {
     TRACE_FUNCTION;
     last_write = millis();
-    auto ret = OutgoingPacket(client, type, flags, length);
+    auto ret = OutgoingPacket(client, buffer_pool, type, flags, length);
     ret.write_header();
     return ret;
 }
@@ -55,25 +58,26 @@ void Connection::wait_for_reply(
     TRACE_FUNCTION;
 
     const unsigned long start = millis();
+    bool replied = false;
 
-    while (client.connected() &&
+    while (!replied && client.connected() &&
            (millis() - start < client.socket_timeout_millis)) {
-        IncomingPacket packet(client);
-        if (!packet) {
-            break;
-        }
-
-        last_read = millis();
+        const bool received = receive([this, type, &handler,
+                                       &replied](IncomingPacket & packet) {
+            if (packet.get_type() == type) {
+                replied = true;
+                handler(packet);
+            } else {
+                handle_packet(packet);
+            }
+        });
 
-        if (packet.get_type() == type) {
-            handler(packet);
-            return;
+        if (!received) {
+            yield();
         }
-
-        handle_packet(packet);
     }
 
-    if (client.connected()) {
+    if (!replied && client.connected()) {
         on_timeout();
     }
 }
@@ -159,13 +163,41 @@ void Connection::loop() {
     TRACE_FUNCTION;
 
     // only handle 10 packets max in one go to not starve other connections
-    for (unsigned int i = 0; (i < 10) && client.available(); ++i) {
-        IncomingPacket packet(client);
-        if (!packet.is_valid()) {
-            return;
+    handle_packets(10, (size_t)-1);
+}
+
+size_t Connection::handle_packets(size_t max_packets, size_t max_size) {
+    TRACE_FUNCTION;
+    size_t handled_size = 0;
+    for (size_t i = 0; (i < max_packets) && (handled_size < max_size); ++i) {
+        const bool received = receive([this, &handled_size](
+                                          IncomingPacket & packet) {
+            handled_size += Packet::get_total_size(packet.size);
+            handle_packet(packet);
+        });
+        if (!received) {
+            break;
         }
-        last_read = millis();
-        handle_packet(packet);
+    }
+    return handled_size;
+}
+
+bool Connection::receive(
+    const std::function<void(IncomingPacket & packet)> & handler) {
+    TRACE_FUNCTION;
+    switch (parser.poll()) {
+        case PacketParser::Status::ready:
+            last_read = millis();
+            parser.dispatch(handler);
+            return true;
+
+        case PacketParser::Status::error:
+            parser.reset();
+            on_protocol_violation();
+            return false;
+
+        default:
+            return false;
     }
 }
 
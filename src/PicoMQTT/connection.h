@@ -5,9 +5,12 @@
 #include <functional>
 #include <memory>
 
+#include "buffer_pool.h"
 #include "client_wrapper.h"
+#include "config.h"
 #include "incoming_packet.h"
 #include "outgoing_packet.h"
+#include "packet_parser.h"
 
 namespace PicoMQTT {
 
@@ -26,7 +29,8 @@ enum ConnectReturnCode : uint8_t {
 class Connection {
 public:
     Connection(::Client & client, unsigned long keep_alive_millis = 0,
-               unsigned long socket_timeout_millis = 15 * 1000);
+               unsigned long socket_timeout_millis = 15 * 1000,
+               size_t outgoing_buffer_size = PICOMQTT_OUTGOING_BUFFER_SIZE);
 
     virtual ~Connection() {}
 
@@ -35,6 +39,12 @@ public:
 
     virtual void loop();
 
+    // Sets the size of the buffer in which outgoing packets are assembled
+    // before they're written to the socket.  Set to 0 to disable buffering.
+    void set_outgoing_buffer_size(size_t size) {
+        buffer_pool.set_block_size(size);
+    }
+
 protected:
     class MessageIdGenerator {
     public:
@@ -66,10 +76,21 @@ protected:
     virtual void on_disconnect();
 
     ClientWrapper client;
+    PacketParser parser;
+    BufferPool buffer_pool;
     unsigned long keep_alive_millis;
 
     virtual void handle_packet(IncomingPacket & packet);
 
+    // Receives data without blocking.  Once a packet is ready, passes it to
+    // the handler and returns true.
+    bool receive(const std::function<void(IncomingPacket & packet)> & handler);
+
+    // Handles incoming packets while data is available, up to max_packets
+    // packets or until at least max_size bytes are consumed.  Returns the
+    // total size of the handled packets.
+    size_t handle_packets(size_t max_packets, size_t max_size);
+
 protected:
     unsigned long get_millis_since_last_read() const;
     unsigned long get_millis_since_last_write() const;
@@ -32,7 +32,7 @@ IncomingPacket::~IncomingPacket() {
     }
 #endif
     // read and ignore remaining data
-    while (get_remaining_size() && (read() >= 0));
+    ignore(get_remaining_size());
 }
 
 // disabled functions
@@ -150,8 +150,15 @@ bool IncomingPacket::read_string(char * buffer, size_t len) {
 }
 
 void IncomingPacket::ignore(size_t len) {
-    while (len--) {
-        read();
+    TRACE_FUNCTION;
+    uint8_t chunk[64];
+    while (len) {
+        const int ret = read(chunk, len < sizeof(chunk) ? len : sizeof(chunk));
+        if (ret <= 0) {
+            // connection error
+            return;
+        }
+        len -= ret;
     }
 }
 
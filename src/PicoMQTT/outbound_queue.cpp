@@ -0,0 +1,211 @@
+#include "outbound_queue.h"
+
+#include <utility>
+
+#include "debug.h"
+#include "packet.h"
+
+namespace PicoMQTT {
+
+void OutboundQueue::reserve(size_t max_size, size_t max_length) {
+    TRACE_FUNCTION;
+    clear();
+    entries.clear();
+    entries.resize(max_size ? max_length : 0);
+    entries.shrink_to_fit();
+    this->max_size = max_size;
+}
+
+bool OutboundQueue::push(const SharedBuffer & packet, size_t offset) {
+    TRACE_FUNCTION;
+    const size_t size = packet.size() - offset;
+    if (!size) {
+        return true;
+    }
+
+    if (!fits(size)) {
+        return false;
+    }
+
+    Entry & entry = at(length++);
+    entry.buffer = packet;
+    entry.begin = offset;
+    entry.end = packet.size();
+    entry.packet = true;
+    bytes += size;
+    return true;
+}
+
+bool OutboundQueue::push(const uint8_t * data, size_t size) {
+    TRACE_FUNCTION;
+    if (!size) {
+        return true;
+    }
+
+    if (size > max_size - bytes) {
+        return false;
+    }
+
+    // append to the last slot if it holds a copy with some space left
+    if (length) {
+        Entry & last = at(length - 1);
+        if ((last.buffer.use_count() == 1) &&
+            (last.buffer.size() - last.end >= size)) {
+            memcpy(last.buffer.data() + last.end, data, size);
+            last.end += size;
+            bytes += size;
+            return true;
+        }
+    }
+
+    if (!fits(size)) {
+        return false;
+    }
+
+    // leave some room for the writes which will follow
+    SharedBuffer buffer(size < 128 ? 128 : size);
+    if (!buffer) {
+        return false;
+    }
+    memcpy(buffer.data(), data, size);
+
+    Entry & entry = at(length++);
+    entry.buffer = std::move(buffer);
+    entry.begin = 0;
+    entry.end = size;
+    entry.packet = false;
+    bytes += size;
+    return true;
+}
+
+const uint8_t * OutboundQueue::front() const {
+    TRACE_FUNCTION;
+    if (!length) {
+        return nullptr;
+    }
+    const Entry & entry = entries[head];
+    return entry.buffer.data() + entry.begin;
+}
+
+size_t OutboundQueue::front_size() const {
+    TRACE_FUNCTION;
+    if (!length) {
+        return 0;
+    }
+    const Entry & entry = entries[head];
+    return entry.end - entry.begin;
+}
+
+void OutboundQueue::pop(size_t size) {
+    TRACE_FUNCTION;
+    if (!length) {
+        return;
+    }
+
+    Entry & entry = entries[head];
+    if (size > entry.end - entry.begin) {
+        size = entry.end - entry.begin;
+    }
+    entry.begin += size;
+    bytes -= size;
+
+    if (entry.begin == entry.end) {
+        entry.buffer.reset();
+        head = (head + 1) % entries.size();
+        --length;
+    }
+}
+
+bool OutboundQueue::get_topic(const SharedBuffer & packet,
+                              const uint8_t *& topic, size_t & topic_size) {
+    TRACE_FUNCTION;
+    const uint8_t * data = packet.data();
+    const size_t size = packet.size();
+
+    // type and QoS
+    if ((size < 2) || ((data[0] & 0xf6) != Packet::PUBLISH)) {
+        return false;
+    }
+
+    // skip the remaining length
+    size_t pos = 1;
+    while ((pos < size) && (data[pos] & 0x80)) {
+        ++pos;
+    }
+    ++pos;
+
+    if (pos + 2 > size) {
+        return false;
+    }
+
+    topic_size = (data[pos] << 8) | data[pos + 1];
+    topic = data + pos + 2;
+    return pos + 2 + topic_size <= size;
+}
+
+bool OutboundQueue::replace(const SharedBuffer & packet) {
+    TRACE_FUNCTION;
+    const uint8_t * topic;
+    size_t topic_size;
+    if (!get_topic(packet, topic, topic_size)) {
+        return false;
+    }
+
+    for (size_t index = 0; index < length; ++index) {
+        Entry & entry = at(index);
+        const uint8_t * entry_topic;
+        size_t entry_topic_size;
+        if (!entry.packet || entry.begin ||
+            !get_topic(entry.buffer, entry_topic, entry_topic_size) ||
+            (entry_topic_size != topic_size) ||
+            memcmp(entry_topic, topic, topic_size)) {
+            continue;
+        }
+
+        const size_t old_size = entry.end;
+        if ((packet.size() > old_size) &&
+            (packet.size() - old_size > max_size - bytes)) {
+            return false;
+        }
+
+        bytes = bytes - old_size + packet.size();
+        entry.buffer = packet;
+        entry.end = packet.size();
+        return true;
+    }
+
+    return false;
+}
+
+size_t OutboundQueue::drop_oldest() {
+    TRACE_FUNCTION;
+    for (size_t index = 0; index < length; ++index) {
+        Entry & entry = at(index);
+        if (!entry.packet || entry.begin) {
+            continue;
+        }
+
+        const size_t size = entry.end - entry.begin;
+        for (; index + 1 < length; ++index) {
+            at(index) = std::move(at(index + 1));
+        }
+        at(index).buffer.reset();
+        --length;
+        bytes -= size;
+        return size;
+    }
+    return 0;
+}
+
+void OutboundQueue::clear() {
+    TRACE_FUNCTION;
+    while (length) {
+        entries[head].buffer.reset();
+        head = (head + 1) % entries.size();
+        --length;
+    }
+    head = 0;
+    bytes = 0;
+}
+
+}  // namespace PicoMQTT
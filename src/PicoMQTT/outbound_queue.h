@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <vector>
+
+#include "shared_buffer.h"
+
+namespace PicoMQTT {
+
+/*
+ * Bounded queue of data waiting to be written to a socket.  Entries are kept
+ * in a ring of slots, each referring to (a part of) a SharedBuffer, so a
+ * message sent to many clients is queued by reference.  Other data is copied,
+ * small writes are merged into the last slot when possible.
+ */
+class OutboundQueue {
+public:
+    OutboundQueue() : head(0), length(0), bytes(0), max_size(0) {}
+
+    // Sets the maximum number of queued bytes and slots.  Existing entries
+    // are dropped.
+    void reserve(size_t max_size, size_t max_length);
+
+    // Queue a reference to a packet's data, starting at offset.  Returns
+    // false if the data doesn't fit in the queue.
+    bool push(const SharedBuffer & packet, size_t offset = 0);
+
+    // Queue a copy of the data.  Returns false if it doesn't fit.
+    bool push(const uint8_t * data, size_t size);
+
+    bool empty() const { return !length; }
+    size_t size() const { return bytes; }
+    size_t get_max_size() const { return max_size; }
+
+    // Start and size of the first contiguous chunk of queued data
+    const uint8_t * front() const;
+    size_t front_size() const;
+
+    // Removes size bytes from the front of the queue, at most front_size()
+    void pop(size_t size);
+
+    // If a QoS 0 PUBLISH packet with the same topic is queued and wasn't sent
+    // at all yet, replaces it with the given packet and returns true.
+    bool replace(const SharedBuffer & packet);
+
+    // Removes the oldest packet which wasn't sent at all yet.  Returns its
+    // size or 0 if there's no such packet.
+    size_t drop_oldest();
+
+    bool fits(size_t size) const {
+        return (length < entries.size()) && (size <= max_size - bytes);
+    }
+
+    void clear();
+
+protected:
+    struct Entry {
+        SharedBuffer buffer;
+        size_t begin;
+        size_t end;
+        // set if the entry holds a whole packet (not copied data, which may
+        // be any part of one)
+        bool packet;
+    };
+
+    // Finds the topic of a QoS 0 PUBLISH packet
+    static bool get_topic(const SharedBuffer & packet, const uint8_t *& topic,
+                          size_t & topic_size);
+
+    Entry & at(size_t index) {
+        return entries[(head + index) % entries.size()];
+    }
+
+    std::vector<Entry> entries;
+    size_t head;
+    size_t length;
+    size_t bytes;
+    size_t max_size;
+};
+
+}  // namespace PicoMQTT
@@ -7,32 +7,42 @@
 
 namespace PicoMQTT {
 
-OutgoingPacket::OutgoingPacket(Print & print, Packet::Type type, uint8_t flags,
+OutgoingPacket::OutgoingPacket(Print & print, BufferPool & pool,
+                               Packet::Type type, uint8_t flags,
                                size_t payload_size)
     : Packet(type, flags, payload_size),
       print(print),
-#ifndef PICOMQTT_UNBUFFERED
+      pool(pool),
+      buffer(pool.acquire()),
+      buffer_size(buffer ? pool.get_block_size() : 0),
       buffer_position(0),
-#endif
       state(State::ok) {
     TRACE_FUNCTION;
 }
 
 OutgoingPacket::OutgoingPacket(OutgoingPacket && other)
-    : OutgoingPacket(other) {
+    : Packet(other),
+      print(other.print),
+      pool(other.pool),
+      buffer(other.buffer),
+      buffer_size(other.buffer_size),
+      buffer_position(other.buffer_position),
+      state(other.state) {
     TRACE_FUNCTION;
+    // the buffer now belongs to this packet
+    other.buffer = nullptr;
+    other.buffer_size = 0;
+    other.buffer_position = 0;
     other.state = State::dead;
 }
 
 OutgoingPacket::~OutgoingPacket() {
     TRACE_FUNCTION;
 #ifdef PICOMQTT_DEBUG
-#ifndef PICOMQTT_UNBUFFERED
     if (buffer_position) {
         Serial.printf("OutgoingPacket has unsent data in the buffer (pos=%u)\n",
                       buffer_position);
     }
-#endif
     switch (state) {
         case State::ok:
             Serial.println(F("Unsent OutgoingPacket"));
@@ -50,49 +60,50 @@ OutgoingPacket::~OutgoingPacket() {
             break;
     }
 #endif
+    pool.release(buffer);
 }
 
 size_t OutgoingPacket::write_from_client(::Client & client, size_t length) {
     TRACE_FUNCTION;
     size_t written = 0;
-#ifndef PICOMQTT_UNBUFFERED
-    while (written < length) {
-        const size_t remaining = length - written;
-        const size_t remaining_buffer_space =
-            PICOMQTT_OUTGOING_BUFFER_SIZE - buffer_position;
-        const size_t chunk_size = remaining < remaining_buffer_space
-                                      ? remaining
-                                      : remaining_buffer_space;
+    if (buffer) {
+        while (written < length) {
+            const size_t remaining = length - written;
+            const size_t remaining_buffer_space = buffer_size - buffer_position;
+            const size_t chunk_size = remaining < remaining_buffer_space
+                                          ? remaining
+                                          : remaining_buffer_space;
 
-        const int read_size = client.read(buffer + buffer_position, chunk_size);
-        if (read_size <= 0) {
-            break;
-        }
+            const int read_size =
+                client.read(buffer + buffer_position, chunk_size);
+            if (read_size <= 0) {
+                break;
+            }
 
-        buffer_position += (size_t)read_size;
-        written += (size_t)read_size;
+            buffer_position += (size_t)read_size;
+            written += (size_t)read_size;
 
-        if (buffer_position >= PICOMQTT_OUTGOING_BUFFER_SIZE) {
-            flush();
-        }
-    }
-#else
-    uint8_t buffer[128] __attribute__((aligned(4)));
-    while (written < length) {
-        const size_t remain = length - written;
-        const size_t chunk_size =
-            sizeof(buffer) < remain ? sizeof(buffer) : remain;
-        const int read_size = client.read(buffer, chunk_size);
-        if (read_size <= 0) {
-            break;
+            if (buffer_position >= buffer_size) {
+                flush();
+            }
         }
-        const size_t write_size = print.write(buffer, read_size);
-        written += write_size;
-        if (!write_size) {
-            break;
+    } else {
+        uint8_t chunk[128] __attribute__((aligned(4)));
+        while (written < length) {
+            const size_t remain = length - written;
+            const size_t chunk_size =
+                sizeof(chunk) < remain ? sizeof(chunk) : remain;
+            const int read_size = client.read(chunk, chunk_size);
+            if (read_size <= 0) {
+                break;
+            }
+            const size_t write_size = print.write(chunk, read_size);
+            written += write_size;
+            if (!write_size) {
+                break;
+            }
         }
     }
-#endif
     pos += written;
     return written;
 }
@@ -105,17 +116,19 @@ size_t OutgoingPacket::write_zero(size_t length) {
     return length;
 }
 
-#ifndef PICOMQTT_UNBUFFERED
 size_t OutgoingPacket::write(const void * data, size_t remaining,
                              void * (*memcpy_fn)(void *, const void *,
                                                  size_t n)) {
     TRACE_FUNCTION;
 
+    if (!buffer) {
+        return write_unbuffered(data, remaining, memcpy_fn);
+    }
+
     const char * src = (const char *)data;
 
     while (remaining) {
-        const size_t remaining_buffer_space =
-            PICOMQTT_OUTGOING_BUFFER_SIZE - buffer_position;
+        const size_t remaining_buffer_space = buffer_size - buffer_position;
         const size_t chunk_size = remaining < remaining_buffer_space
                                       ? remaining
                                       : remaining_buffer_space;
@@ -126,7 +139,7 @@ size_t OutgoingPacket::write(const void * data, size_t remaining,
         src += chunk_size;
         remaining -= chunk_size;
 
-        if (buffer_position >= PICOMQTT_OUTGOING_BUFFER_SIZE) {
+        if (buffer_position >= buffer_size) {
             flush();
         }
     }
@@ -135,42 +148,45 @@ size_t OutgoingPacket::write(const void * data, size_t remaining,
     pos += written;
     return written;
 }
-#endif
 
-size_t OutgoingPacket::write(const uint8_t * data, size_t length) {
+size_t OutgoingPacket::write_unbuffered(const void * data, size_t length,
+                                        void * (*memcpy_fn)(void *,
+                                                            const void *,
+                                                            size_t n)) {
     TRACE_FUNCTION;
-#ifndef PICOMQTT_UNBUFFERED
-    return write(data, length, memcpy);
-#else
-    const size_t written = print.write(data, length);
+    const char * src = (const char *)data;
+    size_t written = 0;
+
+    if (memcpy_fn == memcpy) {
+        written = print.write((const uint8_t *)src, length);
+    } else {
+        // data in flash must be copied to RAM first
+        uint8_t chunk[128] __attribute__((aligned(4)));
+        while (written < length) {
+            const size_t remain = length - written;
+            const size_t chunk_size =
+                sizeof(chunk) < remain ? sizeof(chunk) : remain;
+            memcpy_fn(chunk, src + written, chunk_size);
+            const size_t write_size = print.write(chunk, chunk_size);
+            written += write_size;
+            if (!write_size) {
+                break;
+            }
+        }
+    }
+
     pos += written;
     return written;
-#endif
+}
+
+size_t OutgoingPacket::write(const uint8_t * data, size_t length) {
+    TRACE_FUNCTION;
+    return write(data, length, memcpy);
 }
 
 size_t OutgoingPacket::write_P(PGM_P data, size_t length) {
     TRACE_FUNCTION;
-#ifndef PICOMQTT_UNBUFFERED
     return write(data, length, memcpy_P);
-#else
-    // here we will need a buffer
-    uint8_t buffer[128] __attribute__((aligned(4)));
-    size_t written = 0;
-    while (written < length) {
-        const size_t remain = length - written;
-        const size_t chunk_size =
-            sizeof(buffer) < remain ? sizeof(buffer) : remain;
-        memcpy_P(buffer, data, chunk_size);
-        const size_t write_size = print.write(buffer, chunk_size);
-        written += write_size;
-        data += write_size;
-        if (!write_size) {
-            break;
-        }
-    }
-    pos += written;
-    return written;
-#endif
 }
 
 size_t OutgoingPacket::write_u8(uint8_t c) {
@@ -209,10 +225,10 @@ size_t OutgoingPacket::write_header() {
 
 void OutgoingPacket::flush() {
     TRACE_FUNCTION;
-#ifndef PICOMQTT_UNBUFFERED
-    print.write(buffer, buffer_position);
-    buffer_position = 0;
-#endif
+    if (buffer_position) {
+        print.write(buffer, buffer_position);
+        buffer_position = 0;
+    }
 }
 
 bool OutgoingPacket::send() {
@@ -4,21 +4,21 @@
 
 #include <Arduino.h>
 
+#include "buffer_pool.h"
 #include "config.h"
 #include "packet.h"
 
 class Print;
 class Client;
 
-#if PICOMQTT_OUTGOING_BUFFER_SIZE == 0
-#define PICOMQTT_UNBUFFERED
-#endif
-
 namespace PicoMQTT {
 
 class OutgoingPacket : public Packet, public Print {
 public:
-    OutgoingPacket(Print & print, Type type, uint8_t flags,
+    // The packet is assembled in a block taken from the pool, it's written
+    // to print whenever the block fills up.  If no block is available, all
+    // writes go to print directly.
+    OutgoingPacket(Print & print, BufferPool & pool, Type type, uint8_t flags,
                    size_t payload_size);
     virtual ~OutgoingPacket();
 
@@ -43,19 +43,19 @@ public:
     virtual bool send();
 
 protected:
-    OutgoingPacket(const OutgoingPacket &) = default;
-
     size_t write(const void * data, size_t length,
                  void * (*memcpy_fn)(void *, const void *, size_t n));
+    size_t write_unbuffered(const void * data, size_t length,
+                            void * (*memcpy_fn)(void *, const void *,
+                                                size_t n));
     size_t write_packet_length(size_t length);
 
     Print & print;
+    BufferPool & pool;
 
-#ifndef PICOMQTT_UNBUFFERED
-    uint8_t buffer[PICOMQTT_OUTGOING_BUFFER_SIZE] __attribute__((aligned(4)));
-
+    uint8_t * buffer;
+    size_t buffer_size;
     size_t buffer_position;
-#endif
 
     enum class State {
         ok,
@@ -37,6 +37,16 @@ public:
     bool is_valid() { return get_type() != ERROR; }
     size_t get_remaining_size() const { return pos < size ? size - pos : 0; }
 
+    // Size of a whole packet with the given remaining length, i.e. including
+    // the fixed header.
+    static size_t get_total_size(size_t size) {
+        size_t ret = 2 + size;
+        for (; size >= 128; size >>= 7) {
+            ++ret;
+        }
+        return ret;
+    }
+
     const uint8_t head;
     const size_t size;
 
@@ -0,0 +1,222 @@
+#include "packet_parser.h"
+
+#include "debug.h"
+
+namespace PicoMQTT {
+
+PacketParser::PacketParser(::Client & client)
+    : client(client),
+      head(0),
+      size(0),
+      length_size(0),
+      header_complete(false),
+      data(nullptr),
+      position(0) {
+    TRACE_FUNCTION;
+}
+
+PacketParser::~PacketParser() {
+    TRACE_FUNCTION;
+    free(data);
+}
+
+void PacketParser::reset() {
+    TRACE_FUNCTION;
+    free(data);
+    data = nullptr;
+    position = 0;
+    head = 0;
+    size = 0;
+    length_size = 0;
+    header_complete = false;
+}
+
+size_t PacketParser::get_ready_size() const {
+    return size < PICOMQTT_STREAMING_THRESHOLD ? size
+                                               : PICOMQTT_STREAMING_THRESHOLD;
+}
+
+PacketParser::Status PacketParser::poll() {
+    TRACE_FUNCTION;
+
+    while (!header_complete) {
+        if (client.available() <= 0) {
+            return Status::incomplete;
+        }
+
+        const int c = client.read();
+        if (c < 0) {
+            return Status::incomplete;
+        }
+
+        if (!head) {
+            if (!c) {
+                // reserved packet type
+                return Status::error;
+            }
+            head = c;
+            continue;
+        }
+
+        size |= (c & 0x7f) << (7 * length_size);
+        ++length_size;
+
+        if (!(c & 0x80)) {
+            header_complete = true;
+        } else if (length_size >= 4) {
+            return Status::error;
+        }
+    }
+
+    const size_t ready_size = get_ready_size();
+
+    if (!data) {
+        if ((size_t)client.available() >= ready_size) {
+            // all there, no need to copy
+            return Status::ready;
+        }
+
+        data = (uint8_t *)malloc(ready_size);
+        if (!data) {
+            return Status::error;
+        }
+    }
+
+    while (position < ready_size) {
+        const int available = client.available();
+        if (available <= 0) {
+            return Status::incomplete;
+        }
+
+        const size_t remaining = ready_size - position;
+        const int ret = client.read(
+            data + position,
+            (size_t)available < remaining ? available : remaining);
+        if (ret <= 0) {
+            return Status::incomplete;
+        }
+
+        position += ret;
+    }
+
+    return Status::ready;
+}
+
+void PacketParser::dispatch(
+    const std::function<void(IncomingPacket & packet)> & handler) {
+    TRACE_FUNCTION;
+    const uint8_t packet_head = head;
+    const size_t packet_size = size;
+
+    // the reader takes over the collected data
+    Reader reader(client, data, position);
+    data = nullptr;
+    reset();
+
+    IncomingPacket packet(Packet::Type(packet_head & 0xf0), packet_head,
+                          packet_size, reader);
+    handler(packet);
+}
+
+PacketParser::Reader::Reader(::Client & client, uint8_t * data, size_t size)
+    : client(client), data(data), size(size), position(0) {
+    TRACE_FUNCTION;
+}
+
+PacketParser::Reader::~Reader() {
+    TRACE_FUNCTION;
+    free(data);
+}
+
+// these methods are nop dummies
+int PacketParser::Reader::connect(IPAddress ip, uint16_t port) {
+    TRACE_FUNCTION;
+    return 0;
+}
+
+int PacketParser::Reader::connect(const char * host, uint16_t port) {
+    TRACE_FUNCTION;
+    return 0;
+}
+
+#ifdef PICOMQTT_EXTRA_CONNECT_METHODS
+int PacketParser::Reader::connect(IPAddress ip, uint16_t port,
+                                  int32_t timeout) {
+    TRACE_FUNCTION;
+    return 0;
+}
+
+int PacketParser::Reader::connect(const char * host, uint16_t port,
+                                  int32_t timeout) {
+    TRACE_FUNCTION;
+    return 0;
+}
+#endif
+
+size_t PacketParser::Reader::write(const uint8_t * buffer, size_t size) {
+    TRACE_FUNCTION;
+    return 0;
+}
+
+size_t PacketParser::Reader::write(uint8_t value) {
+    TRACE_FUNCTION;
+    return 0;
+}
+
+void PacketParser::Reader::flush() { TRACE_FUNCTION; }
+
+void PacketParser::Reader::stop() { TRACE_FUNCTION; }
+
+// reads
+int PacketParser::Reader::available() {
+    TRACE_FUNCTION;
+    return (size - position) + client.available();
+}
+
+int PacketParser::Reader::read(uint8_t * buf, size_t size) {
+    TRACE_FUNCTION;
+    const size_t buffered_size = this->size - position;
+    const size_t ret = size < buffered_size ? size : buffered_size;
+    if (ret) {
+        memcpy(buf, data + position, ret);
+        position += ret;
+    }
+
+    if (ret == size) {
+        return ret;
+    }
+
+    const int bytes_read = client.read(buf + ret, size - ret);
+    if (bytes_read <= 0) {
+        return ret ? (int)ret : bytes_read;
+    }
+    return ret + bytes_read;
+}
+
+int PacketParser::Reader::read() {
+    TRACE_FUNCTION;
+    if (position < size) {
+        return data[position++];
+    }
+    return client.read();
+}
+
+int PacketParser::Reader::peek() {
+    TRACE_FUNCTION;
+    if (position < size) {
+        return data[position];
+    }
+    return client.peek();
+}
+
+uint8_t PacketParser::Reader::connected() {
+    TRACE_FUNCTION;
+    return (position < size) || client.connected();
+}
+
+PacketParser::Reader::operator bool() {
+    TRACE_FUNCTION;
+    return (position < size) || bool(client);
+}
+
+}  // namespace PicoMQTT
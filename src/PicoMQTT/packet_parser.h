@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include <functional>
+
+#include "config.h"
+#include "incoming_packet.h"
+
+namespace PicoMQTT {
+
+/*
+ * Receives packets without blocking.  poll() consumes whatever data is
+ * available and keeps the partial packet until it's complete.  Packets bigger
+ * than PICOMQTT_STREAMING_THRESHOLD are ready as soon as that many bytes have
+ * arrived, the rest is read from the socket while the packet is handled.
+ *
+ * Data is only copied if a packet arrives in parts, packets which are already
+ * available in full are read straight from the socket.
+ */
+class PacketParser {
+public:
+    enum class Status {
+        incomplete,  // waiting for more data
+        ready,       // call dispatch()
+        error,       // malformed header or out of memory
+    };
+
+    PacketParser(::Client & client);
+    ~PacketParser();
+
+    PacketParser(const PacketParser &) = delete;
+    const PacketParser & operator=(const PacketParser &) = delete;
+
+    Status poll();
+
+    // Passes the ready packet to the handler.  The parser is reset first, so
+    // the handler may receive further packets.
+    void dispatch(const std::function<void(IncomingPacket & packet)> & handler);
+
+    // Drops the partial packet, e.g. when the connection is reset
+    void reset();
+
+protected:
+    // Serves the data collected by the parser, then reads from the socket
+    class Reader : public ::Client {
+    public:
+        Reader(::Client & client, uint8_t * data, size_t size);
+        ~Reader();
+
+        Reader(const Reader &) = delete;
+        const Reader & operator=(const Reader &) = delete;
+
+        virtual int connect(IPAddress ip, uint16_t port) override;
+        virtual int connect(const char * host, uint16_t port) override;
+#ifdef PICOMQTT_EXTRA_CONNECT_METHODS
+        virtual int connect(IPAddress ip, uint16_t port,
+                            int32_t timeout) override;
+        virtual int connect(const char * host, uint16_t port,
+                            int32_t timeout) override;
+#endif
+        virtual size_t write(const uint8_t * buffer, size_t size) override;
+        virtual size_t write(uint8_t value) override;
+        virtual void flush() override;
+        virtual void stop() override;
+
+        virtual int available() override;
+        virtual int read(uint8_t * buf, size_t size) override;
+        virtual int read() override;
+        virtual int peek() override;
+        virtual uint8_t connected() override;
+        virtual operator bool() override;
+
+    protected:
+        ::Client & client;
+        uint8_t * data;
+        size_t size;
+        size_t position;
+    };
+
+    // number of bytes to collect before the packet is ready
+    size_t get_ready_size() const;
+
+    ::Client & client;
+
+    // fixed header
+    uint8_t head;
+    size_t size;
+    uint8_t length_size;
+    bool header_complete;
+
+    // collected content
+    uint8_t * data;
+    size_t position;
+};
+
+}  // namespace PicoMQTT
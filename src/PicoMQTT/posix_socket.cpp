@@ -0,0 +1,405 @@
+#if defined(__linux__)
+
+#include "posix_socket.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+namespace {
+
+void set_socket_options(int fd) {
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+}  // namespace
+
+namespace PicoMQTT {
+
+PosixClient::PosixClient()
+    : write_timeout_millis(5 * 1000),
+      fd(-1),
+      server(nullptr),
+      idle_generation(0),
+      readable(false),
+      hangup(false),
+      send_buffer_size(0) {
+    TRACE_FUNCTION;
+}
+
+PosixClient::PosixClient(int fd, EpollServerSocket * server) : PosixClient() {
+    TRACE_FUNCTION;
+    this->server = server;
+    set_fd(fd);
+}
+
+PosixClient::~PosixClient() {
+    TRACE_FUNCTION;
+    stop();
+}
+
+void PosixClient::set_fd(int fd) {
+    TRACE_FUNCTION;
+    this->fd = fd;
+    readable = true;
+    hangup = false;
+    idle_generation = server ? server->get_generation() - 1 : 0;
+
+    set_socket_options(fd);
+
+    // the kernel reports twice the size, half of it is reserved for overhead
+    socklen_t size = sizeof(send_buffer_size);
+    if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer_size, &size)) {
+        send_buffer_size = 0;
+    }
+    send_buffer_size /= 2;
+}
+
+void PosixClient::on_events(uint32_t events) {
+    TRACE_FUNCTION;
+    if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        hangup = true;
+    }
+    readable = true;
+}
+
+int PosixClient::connect(IPAddress ip, uint16_t port) {
+    TRACE_FUNCTION;
+    char host[16];
+    snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    return connect(host, port);
+}
+
+int PosixClient::connect(const char * host, uint16_t port) {
+    TRACE_FUNCTION;
+    stop();
+
+    char service[6];
+    snprintf(service, sizeof(service), "%u", port);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo * addresses;
+    if (getaddrinfo(host, service, &hints, &addresses)) {
+        return 0;
+    }
+
+    for (addrinfo * a = addresses; a; a = a->ai_next) {
+        const int fd =
+            socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+            set_fd(fd);
+            break;
+        }
+        close(fd);
+    }
+
+    freeaddrinfo(addresses);
+    return this->fd >= 0;
+}
+
+#ifdef PICOMQTT_EXTRA_CONNECT_METHODS
+int PosixClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    TRACE_FUNCTION;
+    return connect(ip, port);
+}
+
+int PosixClient::connect(const char * host, uint16_t port, int32_t timeout) {
+    TRACE_FUNCTION;
+    return connect(host, port);
+}
+#endif
+
+size_t PosixClient::write(const uint8_t * buffer, size_t size) {
+    TRACE_FUNCTION;
+    const unsigned long start_millis = millis();
+    size_t ret = 0;
+
+    while ((fd >= 0) && !hangup && (ret < size)) {
+        const ssize_t bytes_written =
+            send(fd, buffer + ret, size - ret, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (bytes_written > 0) {
+            ret += bytes_written;
+            continue;
+        }
+
+        if ((bytes_written < 0) && (errno == EINTR)) {
+            continue;
+        }
+
+        if ((bytes_written == 0) ||
+            ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+            // connection error
+            hangup = true;
+            break;
+        }
+
+        // send buffer full, wait until there's space
+        const unsigned long elapsed_millis = millis() - start_millis;
+        if (elapsed_millis >= write_timeout_millis) {
+            break;
+        }
+        pollfd p = {fd, POLLOUT, 0};
+        ::poll(&p, 1, write_timeout_millis - elapsed_millis);
+    }
+
+    return ret;
+}
+
+size_t PosixClient::write(uint8_t value) {
+    TRACE_FUNCTION;
+    return write(&value, 1);
+}
+
+int PosixClient::availableForWrite() {
+    TRACE_FUNCTION;
+    int queued;
+    if ((fd < 0) || hangup || ioctl(fd, SIOCOUTQ, &queued)) {
+        return 0;
+    }
+    return queued < send_buffer_size ? send_buffer_size - queued : 0;
+}
+
+int PosixClient::available() {
+    TRACE_FUNCTION;
+    if (fd < 0) {
+        return 0;
+    }
+
+    if (!readable && server) {
+        if (idle_generation != server->get_generation()) {
+            // no events since the socket was drained, it's still idle
+            idle_generation = server->get_generation();
+            return 0;
+        }
+
+        // Asked again before the next Server::loop(), probably while waiting
+        // for more data.  Check for new events.
+        server->poll();
+        if (!readable) {
+            return 0;
+        }
+    }
+
+    int size;
+    if (ioctl(fd, FIONREAD, &size)) {
+        hangup = true;
+        return 0;
+    }
+
+    if (!size) {
+        // Drained, epoll will report when more data arrives.  Sockets which
+        // aren't monitored are always checked.
+        readable = !server;
+        idle_generation = server ? server->get_generation() - 1 : 0;
+    }
+
+    return size;
+}
+
+int PosixClient::read(uint8_t * buf, size_t size) {
+    TRACE_FUNCTION;
+    if (fd < 0) {
+        return -1;
+    }
+
+    const ssize_t ret = recv(fd, buf, size, MSG_DONTWAIT);
+    if (ret > 0) {
+        return ret;
+    }
+
+    if (ret == 0) {
+        // connection closed by peer
+        hangup = true;
+    } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        readable = !server;
+        idle_generation = server ? server->get_generation() - 1 : 0;
+    } else if (errno != EINTR) {
+        hangup = true;
+    }
+
+    return -1;
+}
+
+int PosixClient::read() {
+    TRACE_FUNCTION;
+    uint8_t ret;
+    return read(&ret, 1) == 1 ? ret : -1;
+}
+
+int PosixClient::peek() {
+    TRACE_FUNCTION;
+    uint8_t ret;
+    if ((fd < 0) || (recv(fd, &ret, 1, MSG_DONTWAIT | MSG_PEEK) != 1)) {
+        return -1;
+    }
+    return ret;
+}
+
+void PosixClient::flush() { TRACE_FUNCTION; }
+
+void PosixClient::stop() {
+    TRACE_FUNCTION;
+    if (fd >= 0) {
+        // closing also removes the socket from epoll
+        close(fd);
+        fd = -1;
+    }
+    readable = false;
+    hangup = false;
+}
+
+uint8_t PosixClient::connected() {
+    TRACE_FUNCTION;
+    if (fd < 0) {
+        return false;
+    }
+
+    if (!server && !hangup) {
+        // not monitored, check if the peer closed the connection
+        uint8_t c;
+        const ssize_t ret = recv(fd, &c, 1, MSG_DONTWAIT | MSG_PEEK);
+        if ((ret == 0) ||
+            ((ret < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+             (errno != EINTR))) {
+            hangup = true;
+        }
+    }
+
+    // data received before the connection was closed can still be read
+    return !hangup || (available() > 0);
+}
+
+PosixClient::operator bool() { return fd >= 0; }
+
+EpollServerSocket::EpollServerSocket(uint16_t port, const char * address)
+    : port(port),
+      address(address),
+      listen_fd(-1),
+      epoll_fd(-1),
+      acceptable(false),
+      generation(0) {
+    TRACE_FUNCTION;
+}
+
+EpollServerSocket::~EpollServerSocket() {
+    TRACE_FUNCTION;
+    if (listen_fd >= 0) {
+        close(listen_fd);
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+}
+
+void EpollServerSocket::begin() {
+    TRACE_FUNCTION;
+    if (listen_fd >= 0) {
+        return;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if ((epoll_fd < 0) || (listen_fd < 0)) {
+        return;
+    }
+
+    const int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (address) {
+        inet_pton(AF_INET, address, &addr.sin_addr);
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = nullptr;  // marks the listening socket
+
+    if (bind(listen_fd, (const sockaddr *)&addr, sizeof(addr)) ||
+        listen(listen_fd, SOMAXCONN) ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event)) {
+        close(listen_fd);
+        listen_fd = -1;
+        return;
+    }
+
+    acceptable = true;
+}
+
+void EpollServerSocket::poll() {
+    TRACE_FUNCTION;
+    if (epoll_fd < 0) {
+        return;
+    }
+
+    ++generation;
+
+    epoll_event events[64];
+    int count;
+    do {
+        count = epoll_wait(epoll_fd, events, 64, 0);
+        for (int i = 0; i < count; ++i) {
+            PosixClient * client = (PosixClient *)events[i].data.ptr;
+            if (client) {
+                client->on_events(events[i].events);
+            } else {
+                acceptable = true;
+            }
+        }
+    } while (count == 64);
+}
+
+::Client * EpollServerSocket::accept_client() {
+    TRACE_FUNCTION;
+    if ((listen_fd < 0) || !acceptable) {
+        return nullptr;
+    }
+
+    const int fd =
+        accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            // no more pending connections, wait for the next event
+            acceptable = false;
+        }
+        return nullptr;
+    }
+
+    PosixClient * client = new PosixClient(fd, this);
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = client;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+        delete client;
+        return nullptr;
+    }
+
+    return client;
+}
+
+}  // namespace PicoMQTT
+
+#endif
@@ -0,0 +1,106 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include "debug.h"
+#include "server.h"
+
+namespace PicoMQTT {
+
+class EpollServerSocket;
+
+/*
+ * Arduino Client on top of a POSIX TCP socket, for running PicoMQTT on Linux
+ * (with an Arduino API emulation layer providing Client and the like).
+ *
+ * Sockets accepted by an EpollServerSocket are non-blocking and monitored
+ * with edge-triggered epoll, so checking an idle socket for data costs no
+ * system calls.  Writes block (up to write_timeout_millis) until all data is
+ * sent, like on the microcontrollers.
+ */
+class PosixClient : public ::Client {
+public:
+    PosixClient();
+    PosixClient(int fd, EpollServerSocket * server = nullptr);
+    virtual ~PosixClient();
+
+    PosixClient(const PosixClient &) = delete;
+    const PosixClient & operator=(const PosixClient &) = delete;
+
+    virtual int connect(IPAddress ip, uint16_t port) override;
+    virtual int connect(const char * host, uint16_t port) override;
+#ifdef PICOMQTT_EXTRA_CONNECT_METHODS
+    virtual int connect(IPAddress ip, uint16_t port, int32_t timeout) override;
+    virtual int connect(const char * host, uint16_t port,
+                        int32_t timeout) override;
+#endif
+    virtual size_t write(const uint8_t * buffer, size_t size) override;
+    virtual size_t write(uint8_t value) override;
+    virtual int availableForWrite() override;
+    virtual int available() override;
+    virtual int read(uint8_t * buf, size_t size) override;
+    virtual int read() override;
+    virtual int peek() override;
+    virtual void flush() override;
+    virtual void stop() override;
+    virtual uint8_t connected() override;
+    virtual operator bool() override;
+
+    int get_fd() const { return fd; }
+
+    // Called by the EpollServerSocket with the socket's epoll events
+    void on_events(uint32_t events);
+
+    unsigned long write_timeout_millis;
+
+protected:
+    void set_fd(int fd);
+
+    int fd;
+    EpollServerSocket * server;
+
+    // the epoll generation in which the socket was last found idle
+    unsigned long idle_generation;
+
+    // set by epoll events, cleared when the socket has no more data
+    bool readable;
+
+    // the peer closed the connection or it failed
+    bool hangup;
+
+    int send_buffer_size;
+};
+
+/*
+ * Listening socket for the broker, built on epoll.  New connections and data
+ * on accepted connections are reported by edge-triggered epoll events, which
+ * are collected once per Server::loop() call, in poll().  Idle connections
+ * cost no system calls.
+ */
+class EpollServerSocket : public ServerSocketInterface {
+public:
+    EpollServerSocket(uint16_t port = 1883, const char * address = nullptr);
+    virtual ~EpollServerSocket();
+
+    virtual void begin() override;
+    virtual void poll() override;
+    virtual ::Client * accept_client() override;
+
+    // incremented by every poll()
+    unsigned long get_generation() const { return generation; }
+
+protected:
+    uint16_t port;
+    const char * address;
+    int listen_fd;
+    int epoll_fd;
+    bool acceptable;
+    unsigned long generation;
+};
+
+}  // namespace PicoMQTT
+
+#endif
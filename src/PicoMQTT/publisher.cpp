@@ -4,28 +4,35 @@
 
 namespace PicoMQTT {
 
-Publisher::Publish::Publish(Publisher & publisher, Print & print, uint8_t flags,
+Publisher::Publish::Publish(Publisher & publisher, Print & print,
+                            BufferPool & pool, uint8_t flags,
                             size_t total_size, const char * topic,
-                            size_t topic_size, uint16_t message_id)
-    : OutgoingPacket(print, Packet::PUBLISH, flags, total_size),
+                            size_t topic_size, uint16_t message_id,
+                            const uint8_t * encoded_topic)
+    : OutgoingPacket(print, pool, Packet::PUBLISH, flags, total_size),
       qos((flags >> 1) & 0b11),
       message_id(message_id),
       publisher(publisher) {
     TRACE_FUNCTION;
 
     OutgoingPacket::write_header();
-    write_string(topic, topic_size);
+    if (encoded_topic) {
+        write(encoded_topic, topic_size + 2);
+    } else {
+        write_string(topic, topic_size);
+    }
     if (qos) {
         write_u16(message_id);
     }
 }
 
 Publisher::Publish::Publish(Publisher & publisher, Print & print,
-                            const char * topic, size_t topic_size,
-                            size_t payload_size, uint8_t qos, bool retain,
-                            bool dup, uint16_t message_id)
+                            BufferPool & pool, const char * topic,
+                            size_t topic_size, size_t payload_size,
+                            uint8_t qos, bool retain, bool dup,
+                            uint16_t message_id)
     : Publish(
-          publisher, print,
+          publisher, print, pool,
           (dup ? 0b1000 : 0) | ((qos & 0b11) << 1) | (retain ? 1 : 0),  // flags
           2 + topic_size + (qos ? 2 : 0) + payload_size,  // total size
           topic, topic_size,                              // topic
@@ -34,11 +41,24 @@ Publisher::Publish::Publish(Publisher & publisher, Print & print,
 }
 
 Publisher::Publish::Publish(Publisher & publisher, Print & print,
-                            const char * topic, size_t payload_size,
-                            uint8_t qos, bool retain, bool dup,
-                            uint16_t message_id)
-    : Publish(publisher, print, topic, strlen(topic), payload_size, qos, retain,
-              dup, message_id) {
+                            BufferPool & pool, const char * topic,
+                            size_t payload_size, uint8_t qos, bool retain,
+                            bool dup, uint16_t message_id)
+    : Publish(publisher, print, pool, topic, strlen(topic), payload_size, qos,
+              retain, dup, message_id) {
+    TRACE_FUNCTION;
+}
+
+Publisher::Publish::Publish(Publisher & publisher, Print & print,
+                            BufferPool & pool, const TopicHandle & topic,
+                            size_t payload_size, uint8_t qos, bool retain,
+                            bool dup, uint16_t message_id)
+    : Publish(
+          publisher, print, pool,
+          (dup ? 0b1000 : 0) | ((qos & 0b11) << 1) | (retain ? 1 : 0),  // flags
+          2 + topic.size() + (qos ? 2 : 0) + payload_size,  // total size
+          topic.c_str(), topic.size(),                      // topic
+          message_id, topic.get_encoded()) {
     TRACE_FUNCTION;
 }
 
@@ -6,6 +6,7 @@
 
 #include "debug.h"
 #include "outgoing_packet.h"
+#include "topic_handle.h"
 
 namespace PicoMQTT {
 
@@ -13,19 +14,28 @@ class Publisher {
 public:
     class Publish : public OutgoingPacket {
     private:
-        Publish(Publisher & publisher, Print & print, uint8_t flags,
-                size_t total_size, const char * topic, size_t topic_size,
-                uint16_t message_id);
+        Publish(Publisher & publisher, Print & print, BufferPool & pool,
+                uint8_t flags, size_t total_size, const char * topic,
+                size_t topic_size, uint16_t message_id,
+                const uint8_t * encoded_topic = nullptr);
 
     public:
-        Publish(Publisher & publisher, Print & print, const char * topic,
-                size_t topic_size, size_t payload_size, uint8_t qos = 0,
-                bool retain = false, bool dup = false, uint16_t message_id = 0);
-
-        Publish(Publisher & publisher, Print & print, const char * topic,
-                size_t payload_size, uint8_t qos = 0, bool retain = false,
-                bool dup = false, uint16_t message_id = 0);
-
+        Publish(Publisher & publisher, Print & print, BufferPool & pool,
+                const char * topic, size_t topic_size, size_t payload_size,
+                uint8_t qos = 0, bool retain = false, bool dup = false,
+                uint16_t message_id = 0);
+
+        Publish(Publisher & publisher, Print & print, BufferPool & pool,
+                const char * topic, size_t payload_size, uint8_t qos = 0,
+                bool retain = false, bool dup = false,
+                uint16_t message_id = 0);
+
+        Publish(Publisher & publisher, Print & print, BufferPool & pool,
+                const TopicHandle & topic, size_t payload_size,
+                uint8_t qos = 0, bool retain = false, bool dup = false,
+                uint16_t message_id = 0);
+
+        Publish(Publish &&) = default;
         ~Publish();
 
         virtual bool send() override;
@@ -47,6 +57,18 @@ public:
                              message_id);
     }
 
+    TopicHandle topic(const char * topic) { return TopicHandle(topic); }
+    TopicHandle topic(const String & topic) { return TopicHandle(topic); }
+
+    virtual Publish begin_publish(const TopicHandle & topic,
+                                  const size_t payload_size, uint8_t qos = 0,
+                                  bool retain = false,
+                                  uint16_t message_id = 0) {
+        TRACE_FUNCTION;
+        return begin_publish(topic.c_str(), payload_size, qos, retain,
+                             message_id);
+    }
+
     virtual bool publish(const char * topic, const void * payload,
                          const size_t payload_size, uint8_t qos = 0,
                          bool retain = false, uint16_t message_id = 0) {
@@ -65,6 +87,25 @@ public:
                        message_id);
     }
 
+    virtual bool publish(const TopicHandle & topic, const void * payload,
+                         const size_t payload_size, uint8_t qos = 0,
+                         bool retain = false, uint16_t message_id = 0) {
+        TRACE_FUNCTION;
+        auto packet =
+            begin_publish(topic, payload_size, qos, retain, message_id);
+        packet.write((const uint8_t *)payload, payload_size);
+        return packet.send();
+    }
+
+    template <typename PayloadStringType>
+    bool publish(const TopicHandle & topic, PayloadStringType payload,
+                 uint8_t qos = 0, bool retain = false,
+                 uint16_t message_id = 0) {
+        TRACE_FUNCTION;
+        return publish(topic, (const void *)get_c_str(payload),
+                       get_c_str_len(payload), qos, retain, message_id);
+    }
+
     template <typename TopicStringType, typename PayloadStringType>
     bool publish(TopicStringType topic, PayloadStringType payload,
                  uint8_t qos = 0, bool retain = false,
@@ -92,6 +133,16 @@ public:
                          message_id);
     }
 
+    virtual bool publish_P(const TopicHandle & topic, PGM_P payload,
+                           const size_t payload_size, uint8_t qos = 0,
+                           bool retain = false, uint16_t message_id = 0) {
+        TRACE_FUNCTION;
+        auto packet =
+            begin_publish(topic, payload_size, qos, retain, message_id);
+        packet.write_P(payload, payload_size);
+        return packet.send();
+    }
+
     template <typename TopicStringType>
     bool publish_P(TopicStringType topic, PGM_P payload, uint8_t qos = 0,
                    bool retain = false, uint16_t message_id = 0) {
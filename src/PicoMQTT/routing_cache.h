@@ -0,0 +1,143 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <vector>
+
+#include "debug.h"
+#include "topic_filter.h"
+#include "topic_hash_table.h"
+
+namespace PicoMQTT {
+
+/*
+ * Bounded LRU cache of publish recipients, keyed by topic.
+ *
+ * Each entry is stamped with the generation number passed to put().  Entries
+ * are valid only as long as the generation doesn't change, so the owner can
+ * invalidate the whole cache in constant time by changing its generation
+ * number.
+ */
+template <typename T>
+class RoutingCache {
+public:
+    RoutingCache(size_t capacity)
+        : hits(0),
+          misses(0),
+          capacity(capacity),
+          entries(nullptr),
+          used(0),
+          head(nullptr),
+          tail(nullptr) {}
+
+    ~RoutingCache() { delete[] entries; }
+
+    RoutingCache(const RoutingCache &) = delete;
+    const RoutingCache & operator=(const RoutingCache &) = delete;
+
+    // Returns the cached recipients or null if the topic is not cached or
+    // the entry is outdated.
+    const std::vector<T> * get(const PreparedTopic & topic,
+                               uint32_t generation) {
+        TRACE_FUNCTION;
+        Entry * entry = find(topic);
+        if (!entry || (entry->generation != generation)) {
+            ++misses;
+            return nullptr;
+        }
+        ++hits;
+        move_to_front(*entry);
+        return &entry->values;
+    }
+
+    void put(const PreparedTopic & topic, uint32_t generation,
+             const std::vector<T> & values) {
+        TRACE_FUNCTION;
+        if (!capacity) {
+            return;
+        }
+
+        Entry * entry = find(topic);
+
+        if (!entry) {
+            if (!entries) {
+                entries = new Entry[capacity];
+            }
+
+            if (used < capacity) {
+                entry = &entries[used++];
+            } else {
+                // evict the least recently used entry
+                entry = tail;
+                index.remove(entry->topic.c_str(), entry->hash, entry);
+                unlink(*entry);
+            }
+
+            entry->topic = topic.topic;
+            entry->hash = topic.hash;
+            index.insert(entry->topic.c_str(), entry->hash, entry);
+            link_front(*entry);
+        } else {
+            move_to_front(*entry);
+        }
+
+        entry->generation = generation;
+        entry->values = values;
+    }
+
+    unsigned long hits;
+    unsigned long misses;
+
+protected:
+    struct Entry {
+        Entry() : hash(0), generation(0), prev(nullptr), next(nullptr) {}
+
+        String topic;
+        uint32_t hash;
+        uint32_t generation;
+        std::vector<T> values;
+
+        // neighbors on the LRU list
+        Entry * prev;
+        Entry * next;
+    };
+
+    Entry * find(const PreparedTopic & topic) const {
+        Entry * ret = nullptr;
+        index.find(topic.topic, topic.hash,
+                   [&ret](Entry * entry) { ret = entry; });
+        return ret;
+    }
+
+    void unlink(Entry & entry) {
+        (entry.prev ? entry.prev->next : head) = entry.next;
+        (entry.next ? entry.next->prev : tail) = entry.prev;
+        entry.prev = entry.next = nullptr;
+    }
+
+    void link_front(Entry & entry) {
+        entry.prev = nullptr;
+        entry.next = head;
+        (head ? head->prev : tail) = &entry;
+        head = &entry;
+    }
+
+    void move_to_front(Entry & entry) {
+        if (head != &entry) {
+            unlink(entry);
+            link_front(entry);
+        }
+    }
+
+    const size_t capacity;
+    Entry * entries;
+    size_t used;
+
+    // LRU list, most recently used first
+    Entry * head;
+    Entry * tail;
+
+    TopicHashTable<Entry *> index;
+};
+
+}  // namespace PicoMQTT
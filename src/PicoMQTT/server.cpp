@@ -1,7 +1,10 @@
 #include "server.h"
 
+#include <algorithm>
+
 #include "config.h"
 #include "debug.h"
+#include "posix_socket.h"
 
 namespace {
 
@@ -95,158 +98,222 @@ public:
 
 namespace PicoMQTT {
 
-Server::PrintMux::PrintMux(Server & server) : server(server) {}
+Server::PrintMux::PrintMux(Server & server)
+    : server(server), packet_position(0) {}
 
-size_t Server::PrintMux::write(uint8_t c) {
+void Server::PrintMux::begin(size_t packet_size) {
     TRACE_FUNCTION;
-    for (Client * client = server.clients; client; client = client->next) {
-        if (client->subscribed) {
-            client->get_print().write(c);
-        }
+    packet.reset();
+    packet_position = 0;
+
+    if (server.recipients.empty() ||
+        (packet_size > PICOMQTT_MAX_FANOUT_BUFFER_SIZE)) {
+        return;
+    }
+
+    // on allocation failure the packet is simply streamed
+    packet = SharedBuffer(packet_size);
+}
+
+void Server::PrintMux::dispatch() {
+    TRACE_FUNCTION;
+    // release the buffer first, the recipients may queue their own references
+    SharedBuffer complete(std::move(packet));
+    packet_position = 0;
+    for (Client * client : server.recipients) {
+        client->send(complete);
     }
-    return 1;
+}
+
+size_t Server::PrintMux::write(uint8_t c) {
+    TRACE_FUNCTION;
+    return write(&c, 1);
 }
 
 size_t Server::PrintMux::write(const uint8_t * buf, size_t size) {
     TRACE_FUNCTION;
-    for (Client * client = server.clients; client; client = client->next) {
-        if (client->subscribed) {
-            client->get_print().write(buf, size);
+    if (packet) {
+        const size_t remaining = packet.size() - packet_position;
+        const size_t chunk_size = size < remaining ? size : remaining;
+        memcpy(packet.data() + packet_position, buf, chunk_size);
+        packet_position += chunk_size;
+        if (packet_position < packet.size()) {
+            return size;
+        }
+        dispatch();
+        if (chunk_size == size) {
+            return size;
         }
+        // anything past the announced packet size is just forwarded
+        for (Client * client : server.recipients) {
+            client->get_print().write(buf + chunk_size, size - chunk_size);
+        }
+        return size;
+    }
+
+    for (Client * client : server.recipients) {
+        client->get_print().write(buf, size);
     }
     return size;
 }
 
 void Server::PrintMux::flush() {
     TRACE_FUNCTION;
-    for (Client * client = server.clients; client; client = client->next) {
-        if (client->subscribed) {
-            client->get_print().flush();
-        }
+    for (Client * client : server.recipients) {
+        client->get_print().flush();
     }
 }
 
-Server::Client::Client(Server & server, ::Client * client)
+Server::Client::Client(Server & server, ::Client * client,
+                       IncomingPacket & connect)
     : SocketOwner(client),
-      Connection(*socket, 0, server.socket_timeout_millis),
+      Connection(*socket, 0, server.socket_timeout_millis,
+                 server.buffer_pool.get_block_size()),
       next(nullptr),
       subscribed(false),
       server(server),
-      client_id("<unknown>") {
+      client_id("<unknown>"),
+      slow_since_millis(0),
+      slow(false),
+      deficit(0) {
     TRACE_FUNCTION;
-    wait_for_reply(Packet::CONNECT, [this](IncomingPacket & packet) {
-        TRACE_FUNCTION;
-
-        auto connack = [this](ConnectReturnCode crc) {
-            TRACE_FUNCTION;
-            auto connack = build_packet(Packet::CONNACK, 0, 2);
-            connack.write_u8(0); /* session present always set to zero */
-            connack.write_u8(crc);
-            connack.send();
-            if (crc != CRC_ACCEPTED) {
-                Connection::client.stop();
-            }
-        };
-
-        {
-            // MQTT protocol identifier
-            char buf[4];
-
-            if (packet.read_u16() != 4) {
-                on_protocol_violation();
-                return;
-            }
+    Connection::client.set_queue_size(PICOMQTT_CLIENT_QUEUE_SIZE,
+                                      PICOMQTT_CLIENT_QUEUE_LENGTH);
+    handshake(connect);
+}
 
-            packet.read((uint8_t *)buf, 4);
+void Server::Client::handshake(IncomingPacket & packet) {
+    TRACE_FUNCTION;
 
-            if (memcmp(buf, "MQTT", 4) != 0) {
-                on_protocol_violation();
-                return;
-            }
+    auto connack = [this](ConnectReturnCode crc) {
+        TRACE_FUNCTION;
+        auto connack = build_packet(Packet::CONNACK, 0, 2);
+        connack.write_u8(0); /* session present always set to zero */
+        connack.write_u8(crc);
+        connack.send();
+        if (crc != CRC_ACCEPTED) {
+            Connection::client.stop();
         }
+    };
+
+    {
+        // MQTT protocol identifier
+        char buf[4];
 
-        const uint8_t protocol_level = packet.read_u8();
-        if (protocol_level != 4) {
+        if (packet.read_u16() != 4) {
             on_protocol_violation();
             return;
         }
 
-        const uint8_t connect_flags = packet.read_u8();
-        const bool has_user = connect_flags & (1 << 7);
-        const bool has_pass = connect_flags & (1 << 6);
-        const bool will_retain = connect_flags & (1 << 5);
-        const uint8_t will_qos = (connect_flags >> 3) & 0b11;
-        const bool has_will = connect_flags & (1 << 2);
-        /* const bool clean_session = connect_flags & (1 << 1); */
+        packet.read((uint8_t *)buf, 4);
 
-        if ((has_pass && !has_user) || (will_qos > 2) ||
-            (!has_will && ((will_qos > 0) || will_retain))) {
+        if (memcmp(buf, "MQTT", 4) != 0) {
             on_protocol_violation();
             return;
         }
+    }
 
-        const unsigned long keep_alive_seconds = packet.read_u16();
-        keep_alive_millis = keep_alive_seconds
-                                ? (keep_alive_seconds * 1000 +
-                                   this->server.keep_alive_tolerance_millis)
-                                : 0;
-
-        {
-            const size_t client_id_size = packet.read_u16();
-            if (client_id_size > PICOMQTT_MAX_CLIENT_ID_SIZE) {
-                connack(CRC_IDENTIFIER_REJECTED);
-                return;
-            }
+    const uint8_t protocol_level = packet.read_u8();
+    if (protocol_level != 4) {
+        on_protocol_violation();
+        return;
+    }
 
-            char client_id_buffer[client_id_size + 1];
-            packet.read_string(client_id_buffer, client_id_size);
-            client_id = client_id_buffer;
-        }
+    const uint8_t connect_flags = packet.read_u8();
+    const bool has_user = connect_flags & (1 << 7);
+    const bool has_pass = connect_flags & (1 << 6);
+    const bool will_retain = connect_flags & (1 << 5);
+    const uint8_t will_qos = (connect_flags >> 3) & 0b11;
+    const bool has_will = connect_flags & (1 << 2);
+    /* const bool clean_session = connect_flags & (1 << 1); */
 
-        if (client_id.isEmpty()) {
-            client_id = String((unsigned int)(this), HEX);
-        }
+    if ((has_pass && !has_user) || (will_qos > 2) ||
+        (!has_will && ((will_qos > 0) || will_retain))) {
+        on_protocol_violation();
+        return;
+    }
 
-        if (has_will) {
-            packet.ignore(packet.read_u16());  // will topic
-            packet.ignore(packet.read_u16());  // will payload
-        }
+    const unsigned long keep_alive_seconds = packet.read_u16();
+    keep_alive_millis = keep_alive_seconds
+                            ? (keep_alive_seconds * 1000 +
+                               this->server.keep_alive_tolerance_millis)
+                            : 0;
 
-        // read username
-        const size_t user_size = has_user ? packet.read_u16() : 0;
-        if (user_size > PICOMQTT_MAX_USERPASS_SIZE) {
-            connack(CRC_BAD_USERNAME_OR_PASSWORD);
-            return;
-        }
-        char user[user_size + 1];
-        if (user_size && !packet.read_string(user, user_size)) {
-            on_timeout();
+    {
+        const size_t client_id_size = packet.read_u16();
+        if (client_id_size > PICOMQTT_MAX_CLIENT_ID_SIZE) {
+            connack(CRC_IDENTIFIER_REJECTED);
             return;
         }
 
-        // read password
-        const size_t pass_size = has_pass ? packet.read_u16() : 0;
-        if (pass_size > PICOMQTT_MAX_USERPASS_SIZE) {
-            connack(CRC_BAD_USERNAME_OR_PASSWORD);
-            return;
-        }
-        char pass[pass_size + 1];
-        if (pass_size && !packet.read_string(pass, pass_size)) {
+        char client_id_buffer[client_id_size + 1];
+        if (!packet.read_string(client_id_buffer, client_id_size)) {
             on_timeout();
             return;
         }
+        client_id = client_id_buffer;
+    }
 
-        const auto connect_return_code =
-            this->server.auth(client_id.c_str(), has_user ? user : nullptr,
-                              has_pass ? pass : nullptr);
+    if (client_id.isEmpty()) {
+        client_id = String((unsigned long)(uintptr_t)this, HEX);
+    }
+
+    if (has_will) {
+        packet.ignore(packet.read_u16());  // will topic
+        packet.ignore(packet.read_u16());  // will payload
+    }
+
+    // read username
+    const size_t user_size = has_user ? packet.read_u16() : 0;
+    if (user_size > PICOMQTT_MAX_USERPASS_SIZE) {
+        connack(CRC_BAD_USERNAME_OR_PASSWORD);
+        return;
+    }
+    char user[user_size + 1];
+    if (user_size && !packet.read_string(user, user_size)) {
+        on_timeout();
+        return;
+    }
+
+    // read password
+    const size_t pass_size = has_pass ? packet.read_u16() : 0;
+    if (pass_size > PICOMQTT_MAX_USERPASS_SIZE) {
+        connack(CRC_BAD_USERNAME_OR_PASSWORD);
+        return;
+    }
+    char pass[pass_size + 1];
+    if (pass_size && !packet.read_string(pass, pass_size)) {
+        on_timeout();
+        return;
+    }
+
+    const auto connect_return_code =
+        this->server.auth(client_id.c_str(), has_user ? user : nullptr,
+                          has_pass ? pass : nullptr);
+
+    connack(connect_return_code);
+}
 
-        connack(connect_return_code);
-    });
+Server::Client::~Client() {
+    TRACE_FUNCTION;
+    for (const Subscription * s = subscriptions; s; s = s->next) {
+        server.client_subscriptions.remove(s->filter, this);
+    }
+    server.invalidate_routing();
+    auto it =
+        std::find(server.recipients.begin(), server.recipients.end(), this);
+    if (it != server.recipients.end()) {
+        server.recipients.erase(it);
+    }
 }
 
 void Server::Client::on_message(const char * topic, IncomingPacket & packet) {
     TRACE_FUNCTION;
 
+    if (server.relay(topic, packet)) {
+        return;
+    }
+
     const size_t payload_size = packet.get_remaining_size();
     auto publish = server.begin_publish(topic, payload_size);
 
@@ -358,12 +425,47 @@ Server::Client::SubscriptionId Server::Client::subscribe(
     if (!is_valid_topic_filter(topic_filter.c_str())) {
         return nullptr;
     }
+
+    // Equal topic filters are shared by all clients.  Create the subscription
+    // first, so that the filter is kept alive when a previous subscription
+    // with the same filter is removed below.
+    Subscription * node =
+        new Subscription(server.topic_filters.get(topic_filter));
     unsubscribe(topic_filter);
-    Subscription * node = new Subscription(topic_filter.c_str());
     insert_subscription(node);
+    server.client_subscriptions.insert(node->filter, this);
+    server.invalidate_routing();
     return node;
 }
 
+bool Server::Client::unsubscribe(const String & topic_filter) {
+    TRACE_FUNCTION;
+    const TopicFilter * filter =
+        server.topic_filters.find(topic_filter.c_str());
+    if (!filter) {
+        // no client is subscribed to this filter
+        return false;
+    }
+    for (const Subscription * s = subscriptions; s; s = s->next) {
+        if (&s->filter == filter) {
+            return unsubscribe(s);
+        }
+    }
+    return false;
+}
+
+bool Server::Client::unsubscribe(SubscriptionId id) {
+    TRACE_FUNCTION;
+    for (const Subscription * s = subscriptions; s; s = s->next) {
+        if (s == id) {
+            server.client_subscriptions.remove(s->filter, this);
+            server.invalidate_routing();
+            return Subscriber::unsubscribe(id);
+        }
+    }
+    return false;
+}
+
 void Server::Client::handle_packet(IncomingPacket & packet) {
     TRACE_FUNCTION;
 
@@ -386,8 +488,16 @@ void Server::Client::handle_packet(IncomingPacket & packet) {
     }
 }
 
+void Server::Client::send(const SharedBuffer & packet) {
+    TRACE_FUNCTION;
+    Connection::client.write(packet, server.overflow_policy);
+}
+
 void Server::Client::loop() {
     TRACE_FUNCTION;
+    // send queued data, as much as the socket can take without blocking
+    Connection::client.drain();
+
     if (keep_alive_millis &&
         (get_millis_since_last_read() > keep_alive_millis)) {
         // ping timeout
@@ -395,7 +505,209 @@ void Server::Client::loop() {
         return;
     }
 
-    Connection::loop();
+    if (get_queued_size() <= server.slow_client_queued_size) {
+        slow = false;
+    } else if (!slow) {
+        slow = true;
+        slow_since_millis = millis();
+    } else if (server.slow_client_timeout_millis &&
+               (millis() - slow_since_millis >
+                server.slow_client_timeout_millis)) {
+        // slow consumer
+        on_timeout();
+        return;
+    }
+}
+
+bool Server::Client::serve(size_t quantum) {
+    TRACE_FUNCTION;
+    if (Connection::client.available()) {
+        deficit += quantum;
+        if (deficit > 0) {
+            deficit -= (long)handle_packets((size_t)-1, (size_t)deficit);
+        }
+        if (connected() && Connection::client.available()) {
+            return true;
+        }
+    }
+
+    // an idle client can't save up its share, but it keeps its debt
+    if (deficit > 0) {
+        deficit = 0;
+    }
+    return false;
+}
+
+Server::PendingClient::PendingClient(::Client * client)
+    : socket(client),
+      accepted_millis(millis()),
+      next(nullptr),
+      head(0),
+      size(0),
+      data(nullptr),
+      field(REMAINING_LENGTH),
+      field_size_known(true),
+      field_remaining(0),
+      capacity(0),
+      remaining_length(0),
+      length_size(0),
+      received(0) {
+    TRACE_FUNCTION;
+}
+
+Server::PendingClient::~PendingClient() {
+    TRACE_FUNCTION;
+    free(data);
+}
+
+bool Server::PendingClient::reserve(size_t new_capacity) {
+    TRACE_FUNCTION;
+    if (new_capacity <= capacity) {
+        return true;
+    }
+    uint8_t * new_data = (uint8_t *)realloc(data, new_capacity);
+    if (!new_data) {
+        return false;
+    }
+    data = new_data;
+    capacity = new_capacity;
+    return true;
+}
+
+bool Server::PendingClient::present(Field field) const {
+    // the connect flags are the last but two byte of the variable header
+    const uint8_t connect_flags = data[7];
+    switch (field) {
+        case WILL_TOPIC:
+        case WILL_PAYLOAD:
+            return connect_flags & (1 << 2);
+        case USERNAME:
+            return connect_flags & (1 << 7);
+        case PASSWORD:
+            return connect_flags & (1 << 6);
+        default:
+            return true;
+    }
+}
+
+bool Server::PendingClient::skipped() const {
+    return field_size_known && ((field == WILL_TOPIC) ||
+                                (field == WILL_PAYLOAD) || (field == REST));
+}
+
+bool Server::PendingClient::advance() {
+    TRACE_FUNCTION;
+    while (!field_remaining && (field != DONE)) {
+        if (!field_size_known) {
+            // the size prefix of a string field has just been read
+            field_size_known = true;
+            field_remaining = (data[size - 2] << 8) | data[size - 1];
+
+            // Fields too long to buffer end the packet early, handshake()
+            // rejects the connection after reading their size.
+            if (((field == CLIENT_ID) &&
+                 (field_remaining > PICOMQTT_MAX_CLIENT_ID_SIZE)) ||
+                (((field == USERNAME) || (field == PASSWORD)) &&
+                 (field_remaining > PICOMQTT_MAX_USERPASS_SIZE))) {
+                field = DONE;
+                return true;
+            }
+
+            if (skipped()) {
+                data[size - 2] = data[size - 1] = 0;
+            } else if (!reserve(size + field_remaining + 2)) {
+                return false;
+            }
+            continue;
+        }
+
+        do {
+            field = (Field)(field + 1);
+        } while (!present(field));
+
+        if (field == REST) {
+            field_remaining = remaining_length - received;
+        } else if (field != DONE) {
+            field_size_known = false;
+            field_remaining = 2;
+            if (!reserve(size + 2)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool Server::PendingClient::poll() {
+    TRACE_FUNCTION;
+    while (!complete()) {
+        const int available = socket->available();
+        if (available <= 0) {
+            return socket->connected();
+        }
+
+        if (field == REMAINING_LENGTH) {
+            const int c = socket->read();
+            if (c < 0) {
+                return socket->connected();
+            }
+
+            if (!head) {
+                // the first packet sent by the client must be a CONNECT
+                if ((c & 0xf0) != Packet::CONNECT) {
+                    return false;
+                }
+                head = c;
+                continue;
+            }
+
+            remaining_length |= (c & 0x7f) << (7 * length_size);
+            if (c & 0x80) {
+                if (++length_size >= 4) {
+                    return false;
+                }
+                continue;
+            }
+
+            // the variable header is 10 bytes long, it's followed by the
+            // client id's size
+            field = VARIABLE_HEADER;
+            field_remaining = 10;
+            if (!reserve(10 + 2)) {
+                return false;
+            }
+            continue;
+        }
+
+        if (field_remaining > remaining_length - received) {
+            // the packet ends in the middle of a field
+            return false;
+        }
+
+        uint8_t discard[64];
+        const bool skip = skipped();
+        size_t chunk = (size_t)available < field_remaining ? available
+                                                           : field_remaining;
+        if (skip && (chunk > sizeof(discard))) {
+            chunk = sizeof(discard);
+        }
+
+        const int ret = socket->read(skip ? discard : data + size, chunk);
+        if (ret <= 0) {
+            return socket->connected();
+        }
+
+        received += ret;
+        field_remaining -= ret;
+        if (!skip) {
+            size += ret;
+        }
+
+        if (!advance()) {
+            return false;
+        }
+    }
+    return true;
 }
 
 Server::IncomingPublish::IncomingPublish(IncomingPacket & packet,
@@ -430,12 +742,42 @@ int Server::IncomingPublish::read() {
 Server::Server(std::unique_ptr<ServerSocketInterface> server)
     : keep_alive_tolerance_millis(10 * 1000),
       socket_timeout_millis(5 * 1000),
+      overflow_policy(OverflowPolicy::block),
+      slow_client_queued_size(PICOMQTT_CLIENT_QUEUE_SIZE / 2),
+      slow_client_timeout_millis(0),
+      connect_timeout_millis(5 * 1000),
+      max_pending_clients(16),
+      failed_handshakes(0),
+      client_quantum(1024),
+      loop_budget_millis(20),
+      accept_burst(8),
+      accept_budget_millis(100),
+      connection_rate(0),
+      connection_burst(10),
+      refused_connections(0),
+      skipped_messages(0),
+      skipped_bytes(0),
       server(std::move(server)),
       clients(nullptr),
+      pending_clients(nullptr),
+      pending_clients_count(0),
+      next_served_client(nullptr),
+      connection_tokens((unsigned long)-1),
+      connection_tokens_millis(millis()),
+      routing_cache(PICOMQTT_ROUTING_CACHE_SIZE),
+      routing_generation(next_routing_generation()),
+      buffer_pool(PICOMQTT_OUTGOING_BUFFER_SIZE),
+      unbuffered_pool(0),
       print_mux(*this) {
     TRACE_FUNCTION;
 }
 
+#if !defined(ESP32) && !defined(ESP8266)
+Server::Server(uint16_t port) : Server(new EpollServerSocket(port)) {
+    TRACE_FUNCTION;
+}
+#endif
+
 Server::~Server() {
     Client * current = clients;
     while (current) {
@@ -443,6 +785,13 @@ Server::~Server() {
         delete current;
         current = next;
     }
+
+    PendingClient * pending = pending_clients;
+    while (pending) {
+        PendingClient * next = pending->next;
+        delete pending;
+        pending = next;
+    }
 }
 
 void Server::begin() {
@@ -450,16 +799,85 @@ void Server::begin() {
     server->begin();
 }
 
-void Server::loop() {
+void Server::accept_clients() {
+    TRACE_FUNCTION;
+    const unsigned long accept_start_millis = millis();
+    for (unsigned int accepted = 0; accepted < accept_burst; ++accepted) {
+        if (accepted && accept_budget_millis &&
+            (millis() - accept_start_millis >= accept_budget_millis)) {
+            break;
+        }
+
+        ::Client * client_ptr = server->accept_client();
+        if (!client_ptr) {
+            break;
+        }
+
+        if ((pending_clients_count >= max_pending_clients) ||
+            !admit_connection()) {
+            // too many handshakes in progress or over the connection rate
+            ++refused_connections;
+            client_ptr->stop();
+            delete client_ptr;
+            continue;
+        }
+
+        PendingClient * pending = new PendingClient(client_ptr);
+        pending->next = pending_clients;
+        pending_clients = pending;
+        ++pending_clients_count;
+    }
+}
+
+void Server::poll_pending_clients() {
     TRACE_FUNCTION;
+    PendingClient ** current = &pending_clients;
+    while (*current) {
+        PendingClient * pending = *current;
+        const bool ok = pending->poll();
+
+        if (ok && !pending->complete() &&
+            (millis() - pending->accepted_millis < connect_timeout_millis)) {
+            current = &pending->next;
+            continue;
+        }
 
-    ::Client * client_ptr = server->accept_client();
-    if (client_ptr) {
-        Client * client = new Client(*this, client_ptr);
-        client->next = clients;
-        clients = client;
-        on_connected(client->get_client_id());
+        *current = pending->next;
+        --pending_clients_count;
+
+        if (ok && pending->complete()) {
+            add_client(*pending);
+        } else {
+            // handshake failed or timed out
+            ++failed_handshakes;
+            pending->socket->stop();
+        }
+
+        delete pending;
     }
+}
+
+void Server::add_client(PendingClient & pending) {
+    TRACE_FUNCTION;
+    BufferClient reader(pending.data);
+    IncomingPacket connect(Packet::CONNECT, pending.head, pending.size,
+                           reader);
+
+    Client * client = new Client(*this, pending.socket.release(), connect);
+    client->next = clients;
+    clients = client;
+    invalidate_routing();
+    client->set_conflation(use_conflation(client->get_client_id()));
+    on_connected(client->get_client_id());
+}
+
+void Server::loop() {
+    TRACE_FUNCTION;
+
+    server->poll();
+    accept_clients();
+    poll_pending_clients();
+    serve_clients();
 
     Client ** current = &clients;
     while (*current) {
@@ -469,6 +887,9 @@ void Server::loop() {
         if (!client->connected()) {
             on_disconnected(client->get_client_id());
             *current = client->next;
+            if (next_served_client == client) {
+                next_served_client = client->next;
+            }
             delete client;
         } else {
             current = &client->next;
@@ -476,22 +897,237 @@ void Server::loop() {
     }
 }
 
-bool Server::set_subscribed(const char * topic) {
+void Server::serve_clients() {
     TRACE_FUNCTION;
-    bool any_subscribed = false;
+    if (!clients) {
+        return;
+    }
+
+    size_t clients_count = 0;
     for (Client * client = clients; client; client = client->next) {
-        client->subscribed = (client->get_subscription(topic) != nullptr);
-        any_subscribed |= client->subscribed;
+        ++clients_count;
     }
-    return any_subscribed;
+
+    const unsigned long start_millis = millis();
+    Client * client = next_served_client ? next_served_client : clients;
+
+    // Go round the clients until a whole round passes without any of them
+    // having more data waiting, or until the time budget runs out.  Without a
+    // budget, each client is served once.
+    size_t served = 0;
+    size_t idle = 0;
+    while (idle < clients_count) {
+        if (loop_budget_millis
+                ? (served && (millis() - start_millis >= loop_budget_millis))
+                : (served >= clients_count)) {
+            break;
+        }
+
+        if (client->connected() && client->serve(client_quantum)) {
+            idle = 0;
+        } else {
+            ++idle;
+        }
+        ++served;
+
+        client = client->next ? client->next : clients;
+    }
+
+    next_served_client = client;
+}
+
+bool Server::admit_connection() {
+    TRACE_FUNCTION;
+    if (!connection_rate) {
+        return true;
+    }
+
+    const unsigned long capacity =
+        (connection_burst ? connection_burst : 1) * 1000ul;
+    if (connection_tokens > capacity) {
+        connection_tokens = capacity;
+    }
+
+    // refill, connection_rate thousandths of a token per millisecond
+    const unsigned long now = millis();
+    const unsigned long elapsed = now - connection_tokens_millis;
+    const unsigned long missing = capacity - connection_tokens;
+    connection_tokens_millis = now;
+    if (elapsed > missing / connection_rate) {
+        connection_tokens = capacity;
+    } else {
+        connection_tokens += elapsed * connection_rate;
+    }
+
+    if (connection_tokens < 1000) {
+        return false;
+    }
+
+    connection_tokens -= 1000;
+    return true;
+}
+
+void Server::set_outgoing_buffer_size(size_t size) {
+    TRACE_FUNCTION;
+    buffer_pool.set_block_size(size);
+    for (Client * client = clients; client; client = client->next) {
+        client->set_outgoing_buffer_size(size);
+    }
+}
+
+bool Server::set_subscribed(const char * topic) {
+    TRACE_FUNCTION;
+    for (Client * client : recipients) {
+        client->subscribed = false;
+    }
+
+    const PreparedTopic prepared_topic(topic);
+    const std::vector<Client *> * cached_recipients =
+        routing_cache.get(prepared_topic, routing_generation);
+
+    if (cached_recipients) {
+        recipients = *cached_recipients;
+        for (Client * client : recipients) {
+            client->subscribed = true;
+        }
+    } else {
+        recipients.clear();
+        client_subscriptions.match(prepared_topic, [this](Client * client) {
+            // a client can have multiple matching subscriptions, but it must
+            // receive the message only once
+            if (!client->subscribed) {
+                client->subscribed = true;
+                recipients.push_back(client);
+            }
+        });
+        routing_cache.put(prepared_topic, routing_generation, recipients);
+    }
+
+    return !recipients.empty();
+}
+
+uint32_t Server::next_routing_generation() {
+    static uint32_t last_generation = 0;
+    if (!++last_generation) {
+        // wrapped around, skip 0
+        ++last_generation;
+    }
+    return last_generation;
+}
+
+bool Server::set_subscribed(const TopicHandle & topic) {
+    TRACE_FUNCTION;
+    HandleRoute * route = static_cast<HandleRoute *>(topic.get_route(this));
+
+    if (!route) {
+        route = new HandleRoute(*this);
+        topic.set_route(route);
+    }
+
+    if (route->generation == routing_generation) {
+        for (Client * client : recipients) {
+            client->subscribed = false;
+        }
+        recipients = route->recipients;
+        for (Client * client : recipients) {
+            client->subscribed = true;
+        }
+    } else {
+        set_subscribed(topic.c_str());
+        route->recipients = recipients;
+        route->generation = routing_generation;
+    }
+
+    return !recipients.empty();
 }
 
 Publisher::Publish Server::begin_publish(const char * topic,
                                          const size_t payload_size, uint8_t,
                                          bool, uint16_t) {
     TRACE_FUNCTION;
-    set_subscribed(topic);
-    return Publish(*this, print_mux, topic, payload_size);
+    const size_t topic_size = strlen(topic);
+    if (!set_subscribed(topic)) {
+        // no need to buffer anything, the mux discards all writes
+        print_mux.begin(0);
+        return Publish(*this, print_mux, unbuffered_pool, topic, topic_size,
+                       payload_size);
+    }
+    print_mux.begin(Packet::get_total_size(2 + topic_size + payload_size));
+    return Publish(*this, print_mux, buffer_pool, topic, topic_size,
+                   payload_size);
+}
+
+Publisher::Publish Server::begin_publish(const TopicHandle & topic,
+                                         const size_t payload_size, uint8_t,
+                                         bool, uint16_t) {
+    TRACE_FUNCTION;
+    if (!set_subscribed(topic)) {
+        // no need to buffer anything, the mux discards all writes
+        print_mux.begin(0);
+        return Publish(*this, print_mux, unbuffered_pool, topic, payload_size);
+    }
+    print_mux.begin(
+        Packet::get_total_size(topic.get_encoded_size() + payload_size));
+    return Publish(*this, print_mux, buffer_pool, topic, payload_size);
+}
+
+bool Server::relay(const char * topic, IncomingPacket & packet) {
+    TRACE_FUNCTION;
+    const size_t payload_size = packet.get_remaining_size();
+    const size_t topic_size = strlen(topic);
+    size_t remaining_length = 2 + topic_size + payload_size;
+    const size_t packet_size = Packet::get_total_size(remaining_length);
+
+    if (!set_subscribed(topic)) {
+        // only local callbacks can be interested, skip what they don't read
+        on_message(topic, packet);
+        const size_t remaining = packet.get_remaining_size();
+        if (remaining) {
+            packet.ignore(remaining);
+            ++skipped_messages;
+            skipped_bytes += remaining - packet.get_remaining_size();
+        }
+        return true;
+    }
+
+    if (packet_size > PICOMQTT_MAX_FANOUT_BUFFER_SIZE) {
+        return false;
+    }
+
+    SharedBuffer buffer(packet_size);
+    if (!buffer) {
+        return false;
+    }
+
+    // fixed header, remaining length and topic
+    uint8_t * data = buffer.data();
+    *data++ = Packet::PUBLISH;
+    do {
+        const uint8_t digit = remaining_length & 127;
+        remaining_length >>= 7;
+        *data++ = digit | (remaining_length ? 0x80 : 0);
+    } while (remaining_length);
+    *data++ = topic_size >> 8;
+    *data++ = topic_size & 0xff;
+    memcpy(data, topic, topic_size);
+    data += topic_size;
+
+    // the payload is read straight into the packet
+    if (packet.read(data, payload_size) != (int)payload_size) {
+        // connection error
+        return true;
+    }
+
+    for (Client * client : recipients) {
+        client->send(buffer);
+    }
+
+    // local callbacks read from the same buffer
+    BufferClient reader(data);
+    IncomingPacket local_packet(IncomingPacket::PUBLISH, 0, payload_size,
+                                reader);
+    on_message(topic, local_packet);
+    return true;
 }
 
 void Server::on_message(const char * topic, IncomingPacket & packet) {
@@ -511,6 +1147,19 @@ bool ServerLocalSubscribe::publish(const char * topic, const void * payload,
     return ret;
 }
 
+bool ServerLocalSubscribe::publish(const TopicHandle & topic,
+                                   const void * payload,
+                                   const size_t payload_size, uint8_t qos,
+                                   bool retain, uint16_t message_id) {
+    TRACE_FUNCTION;
+    const bool ret =
+        Server::publish(topic, payload, payload_size, qos, retain, message_id);
+    BufferClient buffer(payload);
+    IncomingPacket packet(IncomingPacket::PUBLISH, 0, payload_size, buffer);
+    fire_message_callbacks(topic.c_str(), packet);
+    return ret;
+}
+
 bool ServerLocalSubscribe::publish_P(const char * topic, PGM_P payload,
                                      const size_t payload_size, uint8_t qos,
                                      bool retain, uint16_t message_id) {
@@ -523,4 +1172,16 @@ bool ServerLocalSubscribe::publish_P(const char * topic, PGM_P payload,
     return ret;
 }
 
+bool ServerLocalSubscribe::publish_P(const TopicHandle & topic, PGM_P payload,
+                                     const size_t payload_size, uint8_t qos,
+                                     bool retain, uint16_t message_id) {
+    TRACE_FUNCTION;
+    const bool ret = Server::publish_P(topic, payload, payload_size, qos,
+                                       retain, message_id);
+    BufferClientP buffer((void *)payload);
+    IncomingPacket packet(IncomingPacket::PUBLISH, 0, payload_size, buffer);
+    fire_message_callbacks(topic.c_str(), packet);
+    return ret;
+}
+
 }  // namespace PicoMQTT
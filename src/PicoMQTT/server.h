@@ -6,7 +6,7 @@
 #include <WiFi.h>
 #elif defined(ESP8266)
 #include <ESP8266WiFi.h>
-#else
+#elif !defined(__linux__)
 #error "This board is not supported."
 #endif
 
@@ -17,7 +17,10 @@
 #include "incoming_packet.h"
 #include "pico_interface.h"
 #include "publisher.h"
+#include "routing_cache.h"
+#include "shared_buffer.h"
 #include "subscriber.h"
+#include "topic_index.h"
 #include "utils.h"
 
 namespace PicoMQTT {
@@ -33,6 +36,9 @@ public:
 
     virtual void begin() = 0;
     virtual ::Client * accept_client() = 0;
+
+    // Called at the start of every Server::loop(), before accepting clients
+    virtual void poll() {}
 };
 
 template <typename Server>
@@ -107,6 +113,13 @@ public:
         }
     }
 
+    virtual void poll() override {
+        TRACE_FUNCTION;
+        for (auto & server : servers) {
+            server->poll();
+        }
+    }
+
 protected:
     template <typename Server>
     void add(Server & server) {
@@ -131,16 +144,46 @@ public:
                    public Connection,
                    public Subscriber {
     public:
-        Client(Server & server, ::Client * client);
+        // Takes ownership of the socket and processes the CONNECT packet
+        // already received on it.
+        Client(Server & server, ::Client * client, IncomingPacket & connect);
+        virtual ~Client();
 
         void on_message(const char * topic, IncomingPacket & packet) override;
 
         Print & get_print() { return Connection::client; }
+
+        // Sends (or queues) a packet serialized for multiple clients
+        void send(const SharedBuffer & packet);
+
+        // Data waiting to be sent to the client
+        size_t get_queued_size() const {
+            return Connection::client.get_queued_size();
+        }
+        unsigned long get_queued_millis() const {
+            return Connection::client.get_queued_millis();
+        }
+        const OutboundStatistics & get_outbound_statistics() const {
+            return Connection::client.get_statistics();
+        }
+
+        // Keep only the newest message per topic while the client is behind
+        void set_conflation(bool enable) {
+            Connection::client.set_conflation(enable);
+        }
         const char * get_client_id() const { return client_id.c_str(); }
 
+        // Sends queued data and checks timeouts.  Incoming packets are
+        // handled separately, by serve().
         virtual void loop() override;
 
+        // Adds quantum bytes to the client's deficit and handles incoming
+        // packets while it's positive.  Returns true if more data is waiting.
+        bool serve(size_t quantum);
+
         virtual SubscriptionId subscribe(const String & topic_filter) override;
+        virtual bool unsubscribe(const String & topic_filter) override;
+        virtual bool unsubscribe(SubscriptionId id) override;
 
         Client * next;
         bool subscribed;
@@ -149,12 +192,79 @@ public:
         Server & server;
         String client_id;
 
+        // when the queued data last exceeded slow_client_queued_size
+        unsigned long slow_since_millis;
+        bool slow;
+
+        // bytes the client may still send in the current round, negative if
+        // it sent more
+        long deficit;
+
+        void handshake(IncomingPacket & connect);
+
         virtual void on_subscribe(IncomingPacket & packet);
         virtual void on_unsubscribe(IncomingPacket & packet);
 
         virtual void handle_packet(IncomingPacket & packet) override;
     };
 
+    // An accepted connection which hasn't sent a complete CONNECT packet yet.
+    // It's polled from loop() and parses the packet as it arrives, without
+    // blocking.  Only the fields needed for the handshake are buffered, the
+    // will topic and payload are skipped.
+    class PendingClient {
+    public:
+        PendingClient(::Client * client);
+        ~PendingClient();
+
+        PendingClient(const PendingClient &) = delete;
+        const PendingClient & operator=(const PendingClient &) = delete;
+
+        // Reads whatever data is available.  Returns false if the connection
+        // is lost or the client sent something other than a CONNECT packet.
+        bool poll();
+
+        bool complete() const { return field == DONE; }
+
+        std::unique_ptr<::Client> socket;
+        const unsigned long accepted_millis;
+        PendingClient * next;
+
+        // fixed header and content of the packet, with the will topic and
+        // payload replaced by empty strings
+        uint8_t head;
+        size_t size;
+        uint8_t * data;
+
+    protected:
+        enum Field : uint8_t {
+            REMAINING_LENGTH,
+            VARIABLE_HEADER,
+            CLIENT_ID,
+            WILL_TOPIC,
+            WILL_PAYLOAD,
+            USERNAME,
+            PASSWORD,
+            REST,  // anything after the payload, skipped
+            DONE,
+        };
+
+        // Moves on to the next field once the current one is read
+        bool advance();
+        bool present(Field field) const;
+        bool skipped() const;
+        bool reserve(size_t capacity);
+
+        Field field;
+        bool field_size_known;  // false while reading a string's size prefix
+        size_t field_remaining;
+        size_t capacity;
+
+        size_t remaining_length;
+        uint8_t length_size;
+        size_t received;
+    };
+
     class IncomingPublish : public IncomingPacket {
     public:
         IncomingPublish(IncomingPacket & packet, Publish & publish);
@@ -172,10 +282,15 @@ public:
 
     virtual ~Server();
 
+#if defined(ESP32) || defined(ESP8266)
     Server(uint16_t port = 1883)
         : Server(new ServerSocket<::WiFiServer>(port)) {
         TRACE_FUNCTION;
     }
+#else
+    // uses an EpollServerSocket
+    Server(uint16_t port = 1883);
+#endif
 
     template <typename ServerType>
     Server(ServerType & server)
@@ -196,15 +311,88 @@ public:
     virtual Publish begin_publish(const char * topic, const size_t payload_size,
                                   uint8_t qos = 0, bool retain = false,
                                   uint16_t message_id = 0) override;
+    virtual Publish begin_publish(const TopicHandle & topic,
+                                  const size_t payload_size, uint8_t qos = 0,
+                                  bool retain = false,
+                                  uint16_t message_id = 0) override;
 
     unsigned long keep_alive_tolerance_millis;
     unsigned long socket_timeout_millis;
 
+    // What to do with messages for clients whose outbound queue is full
+    OverflowPolicy overflow_policy;
+
+    // Clients with more than slow_client_queued_size bytes of data waiting
+    // to be sent for longer than slow_client_timeout_millis are disconnected.
+    // Set the timeout to 0 to disable.
+    size_t slow_client_queued_size;
+    unsigned long slow_client_timeout_millis;
+
+    // Sets the size of the buffers in which outgoing packets are assembled
+    // before they're written to the sockets (for all clients).  Set to 0 to
+    // disable buffering.
+    void set_outgoing_buffer_size(size_t size);
+
+    // Accepted connections which don't complete the CONNECT handshake within
+    // connect_timeout_millis are dropped.  At most max_pending_clients of them
+    // are kept, further connections are refused until some complete.
+    unsigned long connect_timeout_millis;
+    unsigned int max_pending_clients;
+    unsigned long failed_handshakes;
+
+    // Incoming packets are handled under deficit round robin: in each round,
+    // every client may send about client_quantum bytes.  loop() stops
+    // starting new rounds when nothing more is waiting, and stops handling
+    // packets after loop_budget_millis, to resume with the next client in the
+    // next call.  Set the budget to 0 to handle a single round per call.
+    size_t client_quantum;
+    unsigned long loop_budget_millis;
+
+    // Maximum number of new connections accepted in one loop() call and the
+    // time after which loop() stops accepting more (0 means no limit).
+    unsigned int accept_burst;
+    unsigned long accept_budget_millis;
+
+    // Token bucket limiting the rate of new connections: up to
+    // connection_rate connections per second are admitted on average, in
+    // bursts of up to connection_burst.  Connections over the limit are
+    // closed right after they're accepted.  Set the rate to 0 to disable.
+    unsigned int connection_rate;
+    unsigned int connection_burst;
+    unsigned long refused_connections;
+
+    // Messages received from clients which had no subscribers (and which
+    // weren't read by on_message()) and the size of their skipped payloads
+    unsigned long skipped_messages;
+    unsigned long skipped_bytes;
+
+    // Recipients of recently published topics are cached.  Use the cache's
+    // hits and misses counters to tune PICOMQTT_ROUTING_CACHE_SIZE.
+    const RoutingCache<Client *> & get_routing_cache() const {
+        return routing_cache;
+    }
+
 protected:
+    // Recipients cached in a TopicHandle
+    class HandleRoute : public TopicHandle::Route {
+    public:
+        HandleRoute(const Server & server) : Route(&server), generation(0) {}
+
+        uint32_t generation;
+        std::vector<Client *> recipients;
+    };
+
+    // Forwards writes to all recipients.  If begin() manages to set up a
+    // shared buffer, the packet is collected there instead and written to
+    // each recipient in one go, as soon as it's complete.
     class PrintMux : public ::Print {
     public:
         PrintMux(Server & server);
 
+        // Called before writing a packet of the given size (including the
+        // fixed header) to the recipients.
+        void begin(size_t packet_size);
+
         virtual size_t write(uint8_t c) override final;
 
         virtual size_t write(const uint8_t * buf, size_t size) override final;
@@ -212,6 +400,12 @@ protected:
         virtual void flush() override final;
 
         Server & server;
+
+    protected:
+        void dispatch();
+
+        SharedBuffer packet;
+        size_t packet_position;
     };
 
     Server(ServerSocketInterface * socket)
@@ -220,6 +414,15 @@ protected:
     }
 
     virtual void on_message(const char * topic, IncomingPacket & packet);
+
+    // Forwards a message received from a client to the subscribers and passes
+    // it to on_message().  The payload is read once, into a buffer shared by
+    // all of them.  Messages without subscribers are only passed to
+    // on_message(), whatever it doesn't read is skipped.  Returns false
+    // (without consuming the payload) if the message has subscribers, but
+    // doesn't fit in the buffer.
+    bool relay(const char * topic, IncomingPacket & packet);
+
     virtual ConnectReturnCode auth(const char * client_id,
                                    const char * username,
                                    const char * password) {
@@ -227,15 +430,58 @@ protected:
     }
 
     virtual void on_connected(const char * client_id) {}
+
+    // Return true to enable conflation for a newly connected client, see
+    // Client::set_conflation()
+    virtual bool use_conflation(const char * client_id) { return false; }
     virtual void on_disconnected(const char * client_id) {}
 
     virtual void on_subscribe(const char * client_id, const char * topic) {}
     virtual void on_unsubscribe(const char * client_id, const char * topic) {}
 
     bool set_subscribed(const char * topic);
+    bool set_subscribed(const TopicHandle & topic);
+
+    // Takes a token from the connection rate limit bucket if possible
+    bool admit_connection();
+
+    void accept_clients();
+    void poll_pending_clients();
+    void serve_clients();
+    void add_client(PendingClient & pending);
+
+    // Called whenever the set of clients or their subscriptions changes.
+    void invalidate_routing() {
+        routing_generation = next_routing_generation();
+    }
+
+    // Routing generations are unique across all Server instances, so a route
+    // left in a TopicHandle by a destroyed Server never matches a new Server,
+    // even if it's created at the same address.  0 is never used.
+    static uint32_t next_routing_generation();
 
     std::unique_ptr<ServerSocketInterface> server;
     Client * clients;
+    PendingClient * pending_clients;
+    unsigned int pending_clients_count;
+
+    // the client to serve first in the next call to serve_clients()
+    Client * next_served_client;
+
+    // connection rate limit bucket, in thousandths of a token
+    unsigned long connection_tokens;
+    unsigned long connection_tokens_millis;
+
+    TopicFilterPool topic_filters;
+    TopicIndex<Client *> client_subscriptions;
+    std::vector<Client *> recipients;
+    RoutingCache<Client *> routing_cache;
+    uint32_t routing_generation;
+    BufferPool buffer_pool;
+
+    // hands out no buffers, used for publishes with no recipients
+    BufferPool unbuffered_pool;
+
     PrintMux print_mux;
 };
 
@@ -249,10 +495,19 @@ public:
                          const size_t payload_size, uint8_t qos = 0,
                          bool retain = false, uint16_t message_id = 0) override;
 
+    virtual bool publish(const TopicHandle & topic, const void * payload,
+                         const size_t payload_size, uint8_t qos = 0,
+                         bool retain = false, uint16_t message_id = 0) override;
+
     virtual bool publish_P(const char * topic, PGM_P payload,
                            const size_t payload_size, uint8_t qos = 0,
                            bool retain = false,
                            uint16_t message_id = 0) override;
+
+    virtual bool publish_P(const TopicHandle & topic, PGM_P payload,
+                           const size_t payload_size, uint8_t qos = 0,
+                           bool retain = false,
+                           uint16_t message_id = 0) override;
 };
 
 }  // namespace PicoMQTT
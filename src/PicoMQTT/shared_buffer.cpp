@@ -0,0 +1,49 @@
+#include "shared_buffer.h"
+
+#include <utility>
+
+#include "debug.h"
+
+namespace PicoMQTT {
+
+SharedBuffer::SharedBuffer(size_t size)
+    : block((Block *)malloc(sizeof(Block) + size)) {
+    TRACE_FUNCTION;
+    if (block) {
+        block->references = 1;
+        block->size = size;
+    }
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer & other) : block(other.block) {
+    TRACE_FUNCTION;
+    if (block) {
+        ++block->references;
+    }
+}
+
+SharedBuffer::SharedBuffer(SharedBuffer && other) : block(other.block) {
+    TRACE_FUNCTION;
+    other.block = nullptr;
+}
+
+SharedBuffer::~SharedBuffer() {
+    TRACE_FUNCTION;
+    reset();
+}
+
+SharedBuffer & SharedBuffer::operator=(SharedBuffer other) {
+    TRACE_FUNCTION;
+    std::swap(block, other.block);
+    return *this;
+}
+
+void SharedBuffer::reset() {
+    TRACE_FUNCTION;
+    if (block && !--block->references) {
+        free(block);
+    }
+    block = nullptr;
+}
+
+}  // namespace PicoMQTT
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace PicoMQTT {
+
+/*
+ * A reference counted, fixed size byte buffer.  Copies share the same memory,
+ * which is released when the last copy is destroyed.
+ *
+ * The buffer is allocated with malloc(), so failed allocations can be handled
+ * (check operator bool) on platforms where new can't fail gracefully.  The
+ * reference counter isn't atomic, copies must not be shared between threads.
+ */
+class SharedBuffer {
+public:
+    SharedBuffer() : block(nullptr) {}
+    explicit SharedBuffer(size_t size);
+    SharedBuffer(const SharedBuffer & other);
+    SharedBuffer(SharedBuffer && other);
+    ~SharedBuffer();
+
+    SharedBuffer & operator=(SharedBuffer other);
+
+    uint8_t * data() { return block ? (uint8_t *)(block + 1) : nullptr; }
+    const uint8_t * data() const {
+        return block ? (const uint8_t *)(block + 1) : nullptr;
+    }
+    size_t size() const { return block ? block->size : 0; }
+    size_t use_count() const { return block ? block->references : 0; }
+
+    explicit operator bool() const { return block; }
+
+    // Drops this reference
+    void reset();
+
+protected:
+    struct Block {
+        size_t references;
+        size_t size;
+        // followed by the data
+    };
+
+    Block * block;
+};
+
+}  // namespace PicoMQTT
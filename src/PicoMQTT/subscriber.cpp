@@ -2,10 +2,18 @@
 
 #include "debug.h"
 #include "incoming_packet.h"
+#include "topic_scan.h"
+
+#if PICOMQTT_WIDE_TOPIC_SCAN && defined(PICOMQTT_WIDE_TOPIC_SCANNER)
+#define PICOMQTT_USE_WIDE_TOPIC_SCANNER
+#endif
 
 namespace PicoMQTT {
 
-Subscriber::Subscriber() : subscriptions(nullptr) {}
+Subscriber::Subscriber()
+    : subscriptions(nullptr),
+      wildcard_subscriptions(nullptr),
+      subscription_counter(0) {}
 
 Subscriber::~Subscriber() {
     Subscription * current = subscriptions;
@@ -17,8 +25,81 @@ Subscriber::~Subscriber() {
 }
 
 void Subscriber::insert_subscription(Subscription * subscription) {
+    subscription->filter.compile();
+    subscription->order = ++subscription_counter;
     subscription->next = subscriptions;
     subscriptions = subscription;
+
+    if (subscription->filter.is_literal()) {
+        literal_subscriptions.insert(
+            subscription->topic.c_str(),
+            subscription->filter.get_literal_prefix_hash(), subscription);
+    } else {
+        subscription->next_wildcard = wildcard_subscriptions;
+        wildcard_subscriptions = subscription;
+        wildcard_automaton.insert(subscription->topic.c_str(), subscription);
+    }
+}
+
+void Subscriber::erase_subscription(Subscription ** current) {
+    Subscription * to_delete = *current;
+    *current = to_delete->next;
+
+    if (to_delete->filter.is_literal()) {
+        literal_subscriptions.remove(
+            to_delete->topic.c_str(),
+            to_delete->filter.get_literal_prefix_hash(), to_delete);
+    } else {
+        for (Subscription ** s = &wildcard_subscriptions; *s;
+             s = &(*s)->next_wildcard) {
+            if (*s == to_delete) {
+                *s = to_delete->next_wildcard;
+                break;
+            }
+        }
+        wildcard_automaton.remove(to_delete->topic.c_str(), to_delete);
+        if (!use_wildcard_automaton()) {
+            wildcard_automaton.shrink();
+        }
+    }
+
+    delete to_delete;
+}
+
+bool Subscriber::use_wildcard_automaton() const {
+    return PICOMQTT_TOPIC_AUTOMATON_MIN_FILTERS &&
+           (wildcard_automaton.size() >= PICOMQTT_TOPIC_AUTOMATON_MIN_FILTERS);
+}
+
+Subscriber::Subscription * Subscriber::find_subscription(
+    const PreparedTopic & topic) const {
+    Subscription * ret = nullptr;
+
+    literal_subscriptions.find(topic.topic, topic.hash,
+                               [&ret](Subscription * s) { ret = s; });
+
+    if (use_wildcard_automaton() &&
+        wildcard_automaton.match(topic.topic, [&ret](Subscription * s) {
+            if (!ret || (s->order > ret->order)) {
+                ret = s;
+            }
+        })) {
+        return ret;
+    }
+
+    // Without the automaton (or if it grew too big), check the wildcard
+    // subscriptions one by one.  They're sorted newest first, so only the
+    // first match can be newer than the literal one.
+    for (Subscription * s = wildcard_subscriptions; s; s = s->next_wildcard) {
+        if (ret && (s->order < ret->order)) {
+            break;
+        }
+        if (s->filter.matches(topic)) {
+            return s;
+        }
+    }
+
+    return ret;
 }
 
 const char * Subscriber::get_subscription_pattern(SubscriptionId id) const {
@@ -27,21 +108,14 @@ const char * Subscriber::get_subscription_pattern(SubscriptionId id) const {
 
 Subscriber::SubscriptionId Subscriber::get_subscription(
     const char * topic) const {
-    for (const Subscription * s = subscriptions; s; s = s->next) {
-        if (topic_matches(s->topic.c_str(), topic)) {
-            return s;
-        }
-    }
-    return nullptr;
+    return find_subscription(PreparedTopic(topic));
 }
 
 bool Subscriber::unsubscribe(const String & topic_filter) {
     Subscription ** current = &subscriptions;
     while (*current) {
         if ((*current)->topic == topic_filter) {
-            Subscription * to_delete = *current;
-            *current = to_delete->next;
-            delete to_delete;
+            erase_subscription(current);
             return true;
         }
         current = &(*current)->next;
@@ -56,9 +130,7 @@ bool Subscriber::unsubscribe(SubscriptionId id) {
     Subscription ** current = &subscriptions;
     while (*current) {
         if (*current == id) {
-            Subscription * to_delete = *current;
-            *current = to_delete->next;
-            delete to_delete;
+            erase_subscription(current);
             return true;
         }
         current = &(*current)->next;
@@ -67,24 +139,7 @@ bool Subscriber::unsubscribe(SubscriptionId id) {
 }
 
 String Subscriber::get_topic_element(const char * topic, size_t index) {
-    while (index && topic[0]) {
-        if (topic++[0] == '/') {
-            --index;
-        }
-    }
-
-    if (!topic[0]) {
-        return "";
-    }
-
-    const char * end = topic;
-    while (*end && *end != '/') {
-        ++end;
-    }
-
-    String ret;
-    ret.concat(topic, end - topic);
-    return ret;
+    return TopicView(topic)[index].to_string();
 }
 
 String Subscriber::get_topic_element(const String & topic, size_t index) {
@@ -93,6 +148,20 @@ String Subscriber::get_topic_element(const String & topic, size_t index) {
 }
 
 bool Subscriber::topic_matches(const char * p, const char * t) {
+    return topic_matches(p, t, nullptr, 0);
+}
+
+bool Subscriber::topic_matches(const char * p, const char * t,
+                               TopicSegment * captures, size_t capture_count) {
+#ifdef PICOMQTT_USE_WIDE_TOPIC_SCANNER
+    return scan_topic_matches<WideTopicScanner>(
+        p, t, [&captures, &capture_count](const char * level, size_t size) {
+            if (capture_count) {
+                *captures++ = TopicSegment(level, size);
+                --capture_count;
+            }
+        });
+#else
     while (true) {
         if (*p == '#') {
             return true;  // valid filter => '#' is terminal and matches
@@ -103,19 +172,25 @@ bool Subscriber::topic_matches(const char * p, const char * t) {
             return *t == '\0';
         }
 
-        if (*t == '\0') {
-            // allow parent-topic match: "home/#" matches "home"
-            return p[0] == '/' && p[1] == '#' && p[2] == '\0';
-        }
-
         if (*p == '+') {
+            // may match an empty level too: "home/+" matches "home/"
+            const char * level = t;
             while (*t && *t != '/') {
                 ++t;
             }
+            if (capture_count) {
+                *captures++ = TopicSegment(level, t - level);
+                --capture_count;
+            }
             ++p;
             continue;
         }
 
+        if (*t == '\0') {
+            // allow parent-topic match: "home/#" matches "home"
+            return p[0] == '/' && p[1] == '#' && p[2] == '\0';
+        }
+
         if (*p != *t) {
             return false;
         }
@@ -123,10 +198,14 @@ bool Subscriber::topic_matches(const char * p, const char * t) {
         ++p;
         ++t;
     }
+#endif
 }
 
 bool Subscriber::is_valid_topic_filter(const char * topic_filter) {
     TRACE_FUNCTION;
+#ifdef PICOMQTT_USE_WIDE_TOPIC_SCANNER
+    return scan_is_valid_topic_filter<WideTopicScanner>(topic_filter);
+#else
     if (!topic_filter || topic_filter[0] == '\0') {
         return false;
     }
@@ -190,6 +269,7 @@ bool Subscriber::is_valid_topic_filter(const char * topic_filter) {
                 return *topic_filter == '\0';
         }
     }
+#endif
 }
 
 Subscriber::SubscriptionId SubscribedMessageListener::subscribe(
@@ -221,43 +301,21 @@ Subscriber::SubscriptionId SubscribedMessageListener::subscribe(
 void SubscribedMessageListener::fire_message_callbacks(
     const char * topic, IncomingPacket & packet) {
     TRACE_FUNCTION;
-    for (Subscription * s = subscriptions; s; s = s->next) {
-        if (topic_matches(s->topic.c_str(), topic)) {
-            static_cast<SubscriptionWithCallback *>(s)->callback(
-                const_cast<char *>(topic), packet);
-            return;
-        }
+    Subscription * s = find_subscription(PreparedTopic(topic));
+    if (s) {
+        static_cast<SubscriptionWithCallback *>(s)->callback(
+            const_cast<char *>(topic), packet);
+        return;
     }
     on_extra_message(topic, packet);
 }
 
-template <typename Invoke>
-static SubscribedMessageListener::MessageCallback make_payload_callback(
-    SubscribedMessageListener * self, Invoke invoke, size_t max_size) {
-    return [self, invoke, max_size](char * topic, IncomingPacket & packet) {
-        const size_t payload_size = packet.get_remaining_size();
-        if (payload_size >= max_size) {
-            self->on_message_too_big(topic, packet);
-            return;
-        }
-        char payload[payload_size + 1];
-        if (packet.read((uint8_t *)payload, payload_size) !=
-            (int)payload_size) {
-            // connection error, ignore
-            return;
-        }
-        payload[payload_size] = '\0';
-        invoke(topic, payload, payload_size);
-    };
-}
-
 Subscriber::SubscriptionId SubscribedMessageListener::subscribe(
     const String & topic_filter,
     std::function<void(char *, void *, size_t)> callback, size_t max_size) {
     TRACE_FUNCTION;
     return subscribe(topic_filter,
                      make_payload_callback(
-                         this,
                          [callback](char * topic, char * payload, size_t size) {
                              callback(topic, payload, size);
                          },
@@ -270,7 +328,6 @@ Subscriber::SubscriptionId SubscribedMessageListener::subscribe(
     TRACE_FUNCTION;
     return subscribe(topic_filter,
                      make_payload_callback(
-                         this,
                          [callback](char * topic, char * payload, size_t) {
                              callback(topic, payload);
                          },
@@ -284,7 +341,6 @@ Subscriber::SubscriptionId SubscribedMessageListener::subscribe(
     return subscribe(
         topic_filter,
         make_payload_callback(
-            this,
             [callback](char *, char * payload, size_t) { callback(payload); },
             max_size));
 }
@@ -295,7 +351,6 @@ Subscriber::SubscriptionId SubscribedMessageListener::subscribe(
     TRACE_FUNCTION;
     return subscribe(topic_filter,
                      make_payload_callback(
-                         this,
                          [callback](char *, char * payload, size_t size) {
                              callback(payload, size);
                          },
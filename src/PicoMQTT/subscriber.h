@@ -5,28 +5,60 @@
 #include <functional>
 
 #include "config.h"
+#include "incoming_packet.h"
+#include "topic_automaton.h"
+#include "topic_filter.h"
+#include "topic_hash_table.h"
+#include "topic_pattern.h"
+#include "topic_view.h"
 
 namespace PicoMQTT {
 
-class IncomingPacket;
-
 class Subscriber {
 protected:
     struct Subscription {
-        Subscription(const String & topic) : topic(topic), next(nullptr) {}
+        Subscription(const String & topic)
+            : Subscription(*new TopicFilter(topic)) {}
+        Subscription(TopicFilter & filter)
+            : filter(filter.acquire()),
+              topic(filter.text),
+              next(nullptr),
+              next_wildcard(nullptr),
+              order(0) {}
         Subscription(const Subscription &) = delete;
         Subscription & operator=(const Subscription &) = delete;
 
-        virtual ~Subscription() {}
+        virtual ~Subscription() { filter.release(); }
 
-        const String topic;
+        // compiled by insert_subscription(), possibly shared with other
+        // subscriptions
+        TopicFilter & filter;
+        const String & topic;
         Subscription * next;
+
+        // next subscription in the wildcard_subscriptions list
+        Subscription * next_wildcard;
+
+        // insertion order, newer subscriptions take precedence
+        uint32_t order;
     };
 
     void insert_subscription(Subscription * subscription);
+    void erase_subscription(Subscription ** subscription);
+    Subscription * find_subscription(const PreparedTopic & topic) const;
+    bool use_wildcard_automaton() const;
 
+    // all subscriptions, newest first
     Subscription * subscriptions;
 
+    // subscriptions without wildcards are indexed by topic, others are
+    // additionally linked in a separate list (newest first) and compiled into
+    // an automaton if there are many of them
+    TopicHashTable<Subscription *> literal_subscriptions;
+    Subscription * wildcard_subscriptions;
+    mutable TopicAutomaton<Subscription *> wildcard_automaton;
+    uint32_t subscription_counter;
+
 public:
     typedef const Subscription * SubscriptionId;
 
@@ -35,6 +67,13 @@ public:
     virtual ~Subscriber();
 
     static bool topic_matches(const char * topic_filter, const char * topic);
+
+    // Like above, but additionally stores the levels matched by the '+'
+    // wildcards in captures (up to capture_count of them).  The captures are
+    // only meaningful if the topic matches.
+    static bool topic_matches(const char * topic_filter, const char * topic,
+                              TopicSegment * captures, size_t capture_count);
+
     static bool is_valid_topic_filter(const char * topic_filter);
     static String get_topic_element(const char * topic, size_t index);
     static String get_topic_element(const String & topic, size_t index);
@@ -77,12 +116,94 @@ public:
                              std::function<void(char *)> callback,
                              size_t max_size = PICOMQTT_MAX_MESSAGE_SIZE);
 
+    // Subscriptions using topic patterns validated at compile time, see
+    // PICOMQTT_TOPIC_PATTERN.  The values of the '+' wildcards are passed to
+    // the callback as the leading TopicSegment arguments.  The topic has
+    // already been matched when the callback fires, so the values are just
+    // picked from the levels at the wildcards' positions.
+    template <size_t N, size_t L>
+    SubscriptionId subscribe(
+        const TopicPattern<N, L> & pattern,
+        typename TopicPatternCallback<N, IncomingPacket &>::type callback) {
+        typedef TopicPattern<N, L> Pattern;
+        const typename Pattern::Positions positions =
+            pattern.get_wildcard_positions();
+        return subscribe(
+            pattern.text,
+            [positions, callback](char * topic, IncomingPacket & packet) {
+                typename Pattern::Captures captures;
+                Pattern::capture(topic, positions, captures);
+                Pattern::invoke(callback, captures, packet);
+            });
+    }
+
+    template <size_t N, size_t L>
+    SubscriptionId subscribe(
+        const TopicPattern<N, L> & pattern,
+        typename TopicPatternCallback<N, char *>::type callback,
+        size_t max_size = PICOMQTT_MAX_MESSAGE_SIZE) {
+        typedef TopicPattern<N, L> Pattern;
+        const typename Pattern::Positions positions =
+            pattern.get_wildcard_positions();
+        return subscribe(
+            pattern.text,
+            make_payload_callback(
+                [positions, callback](char * topic, char * payload, size_t) {
+                    typename Pattern::Captures captures;
+                    Pattern::capture(topic, positions, captures);
+                    Pattern::invoke(callback, captures, payload);
+                },
+                max_size));
+    }
+
+    template <size_t N, size_t L>
+    SubscriptionId subscribe(
+        const TopicPattern<N, L> & pattern,
+        typename TopicPatternCallback<N, void *, size_t>::type callback,
+        size_t max_size = PICOMQTT_MAX_MESSAGE_SIZE) {
+        typedef TopicPattern<N, L> Pattern;
+        const typename Pattern::Positions positions =
+            pattern.get_wildcard_positions();
+        return subscribe(
+            pattern.text,
+            make_payload_callback(
+                [positions, callback](char * topic, char * payload,
+                                      size_t size) {
+                    typename Pattern::Captures captures;
+                    Pattern::capture(topic, positions, captures);
+                    Pattern::invoke(callback, captures, (void *)payload,
+                                    size);
+                },
+                max_size));
+    }
+
     virtual void on_extra_message(const char * topic, IncomingPacket & packet) {
     }
     virtual void on_message_too_big(const char * topic,
                                     IncomingPacket & packet) {}
 
 protected:
+    // Wraps a callable taking the topic, the payload and its size into a
+    // MessageCallback, which reads the payload into a buffer on the stack.
+    template <typename Invoke>
+    MessageCallback make_payload_callback(Invoke invoke, size_t max_size) {
+        return [this, invoke, max_size](char * topic, IncomingPacket & packet) {
+            const size_t payload_size = packet.get_remaining_size();
+            if (payload_size >= max_size) {
+                on_message_too_big(topic, packet);
+                return;
+            }
+            char payload[payload_size + 1];
+            if (packet.read((uint8_t *)payload, payload_size) !=
+                (int)payload_size) {
+                // connection error, ignore
+                return;
+            }
+            payload[payload_size] = '\0';
+            invoke(topic, payload, payload_size);
+        };
+    }
+
     void fire_message_callbacks(const char * topic, IncomingPacket & packet);
 
     class SubscriptionWithCallback : public Subscriber::Subscription {
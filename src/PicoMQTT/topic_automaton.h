@@ -0,0 +1,323 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "config.h"
+#include "debug.h"
+#include "topic_filter.h"
+#include "topic_view.h"
+
+namespace PicoMQTT {
+
+/*
+ * Topic filters compiled into a deterministic automaton over topic levels.
+ * Matching a topic walks it once, taking one transition per level, no matter
+ * how many filters there are.  Each matching value is reported once per
+ * filter it was inserted with.
+ *
+ * The automaton is rebuilt lazily, on the first match() after the set of
+ * filters changes.  It's built by subset construction from a trie of the
+ * filters, where each state represents the set of trie nodes which can be
+ * reached by the levels consumed so far.
+ *
+ * The number of states can grow exponentially with the number of filters.
+ * If the construction needs more than max_states of them, it's abandoned and
+ * match() fails until the filters change again.
+ *
+ * Filters must be valid and must outlive their entries in the automaton.
+ */
+template <typename T>
+class TopicAutomaton {
+public:
+    TopicAutomaton(size_t max_states = PICOMQTT_TOPIC_AUTOMATON_MAX_STATES)
+        : max_states(max_states), dirty(false), too_big(false) {}
+    TopicAutomaton(const TopicAutomaton &) = delete;
+    const TopicAutomaton & operator=(const TopicAutomaton &) = delete;
+
+    void insert(const char * topic_filter, const T & value) {
+        TRACE_FUNCTION;
+        entries.push_back(Entry(topic_filter, value));
+        dirty = true;
+    }
+
+    bool remove(const char * topic_filter, const T & value) {
+        TRACE_FUNCTION;
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if ((it->filter == topic_filter) && (it->value == value)) {
+                entries.erase(it);
+                dirty = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Calls the callback with the values of all filters matching the topic.
+    // Returns false without calling it if the automaton has too many states,
+    // the caller has to match the filters some other way then.
+    template <typename Callback>
+    bool match(const char * topic, Callback && callback) {
+        TRACE_FUNCTION;
+        if (dirty) {
+            build();
+        }
+
+        if (too_big) {
+            return false;
+        }
+
+        if (states.empty()) {
+            return true;
+        }
+
+        size_t state = 0;
+        for (const TopicSegment & level : TopicView(topic)) {
+            state = states[state].next(level);
+            if (state == NONE) {
+                return true;
+            }
+        }
+
+        for (const T & value : states[state].values) {
+            callback(value);
+        }
+        return true;
+    }
+
+    size_t size() const { return entries.size(); }
+
+    // Releases the automaton's tables, they're rebuilt on the next match.
+    void shrink() {
+        states.clear();
+        states.shrink_to_fit();
+        dirty = true;
+    }
+
+protected:
+    static const size_t NONE = (size_t)-1;
+
+    struct Entry {
+        Entry(const char * filter, const T & value)
+            : filter(filter), value(value) {}
+
+        const char * filter;
+        T value;
+    };
+
+    struct Transition {
+        uint32_t hash;
+        TopicSegment level;
+        size_t target;
+
+        bool operator<(const Transition & other) const {
+            return hash < other.hash;
+        }
+    };
+
+    struct State {
+        size_t next(const TopicSegment & level) const {
+            Transition key;
+            key.hash = topic_hash(level.data, level.size);
+            auto it = std::lower_bound(transitions.begin(), transitions.end(),
+                                       key);
+            for (; (it != transitions.end()) && (it->hash == key.hash); ++it) {
+                if ((it->level.size == level.size) &&
+                    !memcmp(it->level.data, level.data, level.size)) {
+                    return it->target;
+                }
+            }
+            return other;
+        }
+
+        // transitions on literal levels, sorted by hash
+        std::vector<Transition> transitions;
+
+        // transition on all other levels
+        size_t other;
+
+        // values of filters which match if the topic ends in this state
+        std::vector<T> values;
+    };
+
+    // Trie of the filters, the nondeterministic version of the automaton
+    struct Node {
+        Node(TopicSegment level = TopicSegment())
+            : level(level), plus(NONE), hash(NONE) {}
+
+        TopicSegment level;
+        std::vector<size_t> children;  // literal levels
+        size_t plus;                   // '+' child
+        size_t hash;                   // '#' child, matches any levels
+        std::vector<T> values;
+    };
+
+    typedef std::vector<size_t> NodeSet;
+
+    size_t add_child(std::vector<Node> & nodes, size_t parent,
+                     const TopicSegment & level) {
+        if ((level.size == 1) && (*level.data == '+' || *level.data == '#')) {
+            size_t & child =
+                (*level.data == '+') ? nodes[parent].plus : nodes[parent].hash;
+            if (child != NONE) {
+                return child;
+            }
+            // push_back() invalidates the reference
+            child = nodes.size();
+            nodes.push_back(Node(level));
+            return nodes.size() - 1;
+        }
+
+        for (size_t child : nodes[parent].children) {
+            if ((nodes[child].level.size == level.size) &&
+                !memcmp(nodes[child].level.data, level.data, level.size)) {
+                return child;
+            }
+        }
+
+        nodes[parent].children.push_back(nodes.size());
+        nodes.push_back(Node(level));
+        return nodes.size() - 1;
+    }
+
+    // Adds the '#' children of the set's nodes (the parent topic rule makes
+    // "home/#" match "home"), sorts the set and removes duplicates.
+    static void close(const std::vector<Node> & nodes, NodeSet & set) {
+        const size_t size = set.size();
+        for (size_t i = 0; i < size; ++i) {
+            if (nodes[set[i]].hash != NONE) {
+                set.push_back(nodes[set[i]].hash);
+            }
+        }
+        std::sort(set.begin(), set.end());
+        set.erase(std::unique(set.begin(), set.end()), set.end());
+    }
+
+    size_t get_state(const std::vector<Node> & nodes, NodeSet & set,
+                     std::map<NodeSet, size_t> & known,
+                     std::vector<NodeSet> & pending) {
+        close(nodes, set);
+        if (set.empty()) {
+            return NONE;
+        }
+
+        auto it = known.find(set);
+        if (it != known.end()) {
+            return it->second;
+        }
+
+        if (states.size() >= max_states) {
+            too_big = true;
+            return NONE;
+        }
+
+        const size_t index = states.size();
+        states.push_back(State());
+        for (size_t node : set) {
+            states[index].values.insert(states[index].values.end(),
+                                        nodes[node].values.begin(),
+                                        nodes[node].values.end());
+        }
+        known[set] = index;
+        pending.push_back(set);
+        return index;
+    }
+
+    void build() {
+        TRACE_FUNCTION;
+        dirty = false;
+        too_big = false;
+        states.clear();
+
+        std::vector<Node> nodes(1);
+        for (const Entry & entry : entries) {
+            size_t node = 0;
+            for (const TopicSegment & level : TopicView(entry.filter)) {
+                node = add_child(nodes, node, level);
+            }
+            nodes[node].values.push_back(entry.value);
+        }
+
+        std::map<NodeSet, size_t> known;
+        std::vector<NodeSet> pending;
+        NodeSet initial(1, 0);
+        get_state(nodes, initial, known, pending);
+
+        // states are created in the same order as they're added to pending
+        for (size_t index = 0; index < pending.size(); ++index) {
+            const NodeSet set = pending[index];
+
+            // levels which don't match any literal child lead here
+            NodeSet other;
+            for (size_t node : set) {
+                if (nodes[node].plus != NONE) {
+                    other.push_back(nodes[node].plus);
+                }
+                if (nodes[node].level.size == 1 &&
+                    *nodes[node].level.data == '#') {
+                    other.push_back(node);
+                }
+            }
+
+            std::vector<Transition> transitions;
+            for (size_t node : set) {
+                for (size_t child : nodes[node].children) {
+                    const TopicSegment & level = nodes[child].level;
+                    bool seen = false;
+                    for (const Transition & t : transitions) {
+                        if ((t.level.size == level.size) &&
+                            !memcmp(t.level.data, level.data, level.size)) {
+                            seen = true;
+                            break;
+                        }
+                    }
+                    if (seen) {
+                        continue;
+                    }
+
+                    // all literal children matching the level, in all nodes
+                    NodeSet target = other;
+                    for (size_t n : set) {
+                        for (size_t c : nodes[n].children) {
+                            if ((nodes[c].level.size == level.size) &&
+                                !memcmp(nodes[c].level.data, level.data,
+                                        level.size)) {
+                                target.push_back(c);
+                            }
+                        }
+                    }
+
+                    Transition transition;
+                    transition.hash = topic_hash(level.data, level.size);
+                    transition.level = level;
+                    transition.target =
+                        get_state(nodes, target, known, pending);
+                    transitions.push_back(transition);
+                }
+            }
+
+            // get_state() may reallocate the states
+            const size_t other_state = get_state(nodes, other, known, pending);
+            std::sort(transitions.begin(), transitions.end());
+            states[index].transitions = std::move(transitions);
+            states[index].other = other_state;
+
+            if (too_big) {
+                states.clear();
+                states.shrink_to_fit();
+                return;
+            }
+        }
+    }
+
+    const size_t max_states;
+    std::vector<Entry> entries;
+    std::vector<State> states;
+    bool dirty;
+    bool too_big;
+};
+
+}  // namespace PicoMQTT
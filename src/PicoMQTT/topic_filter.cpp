@@ -0,0 +1,224 @@
+#include "topic_filter.h"
+
+#include "debug.h"
+
+namespace PicoMQTT {
+
+uint32_t topic_hash(const char * data, size_t size, uint32_t hash) {
+    while (size--) {
+        hash ^= (uint8_t)*data++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+PreparedTopic::PreparedTopic(const char * topic)
+    : topic(topic), size(strlen(topic)), hashed_levels(0) {
+    TRACE_FUNCTION;
+    hash = topic_hash(nullptr, 0);
+    const char * level_start = topic;
+    while (true) {
+        if (hashed_levels >= PICOMQTT_TOPIC_HASH_LEVELS) {
+            hash = topic_hash(level_start, topic + size - level_start, hash);
+            break;
+        }
+
+        const char * level_end = (const char *)memchr(
+            level_start, '/', topic + size - level_start);
+        if (!level_end) {
+            level_end = topic + size;
+        }
+
+        hash = topic_hash(level_start, level_end - level_start, hash);
+        prefix_hash[hashed_levels] = hash;
+        prefix_size[hashed_levels] = level_end - topic;
+        ++hashed_levels;
+
+        if (level_end == topic + size) {
+            break;
+        }
+
+        hash = topic_hash(level_end, 1, hash);
+        level_start = level_end + 1;
+    }
+}
+
+TopicFilter::TopicFilter(const String & text, TopicFilterPool * pool)
+    : text(text),
+      segments(nullptr),
+      segment_count(0),
+      literal_segments(0),
+      literal_prefix_size(0),
+      literal_prefix_hash(0),
+      references(0),
+      pool(pool) {
+    TRACE_FUNCTION;
+}
+
+TopicFilter & TopicFilter::acquire() {
+    TRACE_FUNCTION;
+    ++references;
+    return *this;
+}
+
+void TopicFilter::release() {
+    TRACE_FUNCTION;
+    if (--references) {
+        return;
+    }
+    if (pool) {
+        pool->erase(*this);
+    }
+    delete this;
+}
+
+TopicFilter::~TopicFilter() {
+    TRACE_FUNCTION;
+    delete[] segments;
+}
+
+void TopicFilter::compile() {
+    TRACE_FUNCTION;
+    if (segments) {
+        return;
+    }
+
+    const char * const filter = text.c_str();
+    const size_t size = text.length();
+
+    segment_count = 1;
+    for (size_t i = 0; i < size; ++i) {
+        if (filter[i] == '/') {
+            ++segment_count;
+        }
+    }
+
+    segments = new Segment[segment_count];
+
+    size_t offset = 0;
+    for (size_t i = 0; i < segment_count; ++i) {
+        const char * end =
+            (const char *)memchr(filter + offset, '/', size - offset);
+        const size_t length = (end ? end - filter : size) - offset;
+
+        Segment & segment = segments[i];
+        segment.offset = offset;
+        segment.length = length;
+        if (length == 1 && filter[offset] == '+') {
+            segment.type = SINGLE_LEVEL;
+        } else if (length == 1 && filter[offset] == '#') {
+            segment.type = MULTI_LEVEL;
+        } else {
+            segment.type = LITERAL;
+        }
+
+        offset += length + 1;
+    }
+
+    while ((literal_segments < segment_count) &&
+           (segments[literal_segments].type == LITERAL)) {
+        ++literal_segments;
+    }
+
+    if (literal_segments) {
+        const Segment & last = segments[literal_segments - 1];
+        literal_prefix_size = last.offset + last.length;
+        literal_prefix_hash = topic_hash(filter, literal_prefix_size);
+    }
+}
+
+bool TopicFilter::matches(const PreparedTopic & topic) const {
+    TRACE_FUNCTION;
+    const char * const filter = text.c_str();
+    const char * const end = topic.topic + topic.size;
+
+    // Points to the beginning of the next topic level or is null if all
+    // levels were consumed.
+    const char * t = topic.topic;
+    size_t index = 0;
+
+    if (literal_segments) {
+        if (literal_segments <= PICOMQTT_TOPIC_HASH_LEVELS) {
+            if (literal_segments > topic.hashed_levels) {
+                // topic has fewer levels than the literal prefix
+                return false;
+            }
+            const size_t level = literal_segments - 1;
+            if ((topic.prefix_size[level] != literal_prefix_size) ||
+                (topic.prefix_hash[level] != literal_prefix_hash)) {
+                return false;
+            }
+        } else if ((topic.size < literal_prefix_size) ||
+                   ((topic.size > literal_prefix_size) &&
+                    (topic.topic[literal_prefix_size] != '/'))) {
+            return false;
+        }
+
+        if (memcmp(topic.topic, filter, literal_prefix_size) != 0) {
+            return false;
+        }
+
+        t = (topic.size == literal_prefix_size)
+                ? nullptr
+                : topic.topic + literal_prefix_size + 1;
+        index = literal_segments;
+    }
+
+    for (; index < segment_count; ++index) {
+        const Segment & segment = segments[index];
+
+        if (segment.type == MULTI_LEVEL) {
+            // matches the remaining levels, including none at all (this
+            // allows "home/#" to match "home")
+            return true;
+        }
+
+        if (!t) {
+            return false;
+        }
+
+        const char * level_end = (const char *)memchr(t, '/', end - t);
+        if (!level_end) {
+            level_end = end;
+        }
+
+        if ((segment.type == LITERAL) &&
+            (((size_t)(level_end - t) != segment.length) ||
+             (memcmp(t, filter + segment.offset, segment.length) != 0))) {
+            return false;
+        }
+
+        t = (level_end == end) ? nullptr : level_end + 1;
+    }
+
+    return !t;
+}
+
+TopicFilter & TopicFilterPool::get(const String & text) {
+    TRACE_FUNCTION;
+    TopicFilter * filter = find(text.c_str());
+    if (!filter) {
+        filter = new TopicFilter(text, this);
+        filters.insert(filter->text.c_str(),
+                       topic_hash(filter->text.c_str(), filter->text.length()),
+                       filter);
+    }
+    return *filter;
+}
+
+TopicFilter * TopicFilterPool::find(const char * text) const {
+    TRACE_FUNCTION;
+    TopicFilter * ret = nullptr;
+    filters.find(text, topic_hash(text, strlen(text)),
+                 [&ret](TopicFilter * filter) { ret = filter; });
+    return ret;
+}
+
+void TopicFilterPool::erase(TopicFilter & filter) {
+    TRACE_FUNCTION;
+    filters.remove(filter.text.c_str(),
+                   topic_hash(filter.text.c_str(), filter.text.length()),
+                   &filter);
+}
+
+}  // namespace PicoMQTT
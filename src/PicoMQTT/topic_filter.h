@@ -0,0 +1,124 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "topic_hash_table.h"
+
+namespace PicoMQTT {
+
+// FNV-1a, used to quickly reject topics which can't match a filter
+uint32_t topic_hash(const char * data, size_t size,
+                    uint32_t hash = 2166136261u);
+
+/*
+ * A topic prepared for matching against many filters.  The topic is scanned
+ * only once, when the object is created.
+ */
+class PreparedTopic {
+public:
+    PreparedTopic(const char * topic);
+
+    const char * const topic;
+    const size_t size;
+
+    // hash of the whole topic
+    uint32_t hash;
+
+protected:
+    friend class TopicFilter;
+
+    // prefix_hash[i] is the hash of the topic's first i + 1 levels (without
+    // the trailing separator), prefix_size[i] is their size
+    uint32_t prefix_hash[PICOMQTT_TOPIC_HASH_LEVELS];
+    size_t prefix_size[PICOMQTT_TOPIC_HASH_LEVELS];
+    size_t hashed_levels;
+};
+
+class TopicFilterPool;
+
+/*
+ * Topic filter compiled into a table of segments.  The compiled form allows
+ * matching topics segment by segment and bailing out early on length or hash
+ * mismatches, without rescanning the filter text on every message.
+ *
+ * Topic filters are reference counted, a filter is deleted when its last
+ * reference is released.  Filters which belong to a TopicFilterPool are
+ * shared by all of the pool's users.
+ *
+ * The filter must be valid, see Subscriber::is_valid_topic_filter.
+ */
+class TopicFilter {
+public:
+    enum SegmentType : uint8_t {
+        LITERAL,
+        SINGLE_LEVEL,  // +
+        MULTI_LEVEL,   // #
+    };
+
+    struct Segment {
+        uint16_t offset;
+        uint16_t length;
+        SegmentType type;
+    };
+
+    TopicFilter(const String & text, TopicFilterPool * pool = nullptr);
+    ~TopicFilter();
+
+    TopicFilter(const TopicFilter &) = delete;
+    const TopicFilter & operator=(const TopicFilter &) = delete;
+
+    TopicFilter & acquire();
+    void release();
+
+    void compile();
+    bool is_compiled() const { return segments != nullptr; }
+
+    // true if the filter has no wildcards
+    bool is_literal() const { return literal_segments == segment_count; }
+    uint32_t get_literal_prefix_hash() const { return literal_prefix_hash; }
+
+    bool matches(const PreparedTopic & topic) const;
+
+    const String text;
+
+protected:
+    Segment * segments;
+    size_t segment_count;
+
+    // number of leading literal segments, their total size (including
+    // separators) and the hash of that prefix
+    size_t literal_segments;
+    size_t literal_prefix_size;
+    uint32_t literal_prefix_hash;
+
+    size_t references;
+    TopicFilterPool * const pool;
+};
+
+/*
+ * Intern table of topic filters.  Equal filters obtained from the same pool
+ * are the same object, so they can be compared by address and they share
+ * their text and compiled form.
+ */
+class TopicFilterPool {
+public:
+    TopicFilterPool() {}
+    TopicFilterPool(const TopicFilterPool &) = delete;
+    const TopicFilterPool & operator=(const TopicFilterPool &) = delete;
+
+    // Returns the pooled filter, creating it if needed.  The caller must
+    // acquire the returned filter to keep it alive.
+    TopicFilter & get(const String & text);
+
+    // Returns the pooled filter or null if it's not in use.
+    TopicFilter * find(const char * text) const;
+
+protected:
+    friend class TopicFilter;
+    void erase(TopicFilter & filter);
+
+    TopicHashTable<TopicFilter *> filters;
+};
+
+}  // namespace PicoMQTT
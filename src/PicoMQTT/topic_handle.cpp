@@ -0,0 +1,51 @@
+#include "topic_handle.h"
+
+#include "debug.h"
+
+namespace PicoMQTT {
+
+TopicHandle::TopicHandle(const char * topic) : route(nullptr) {
+    TRACE_FUNCTION;
+    init(topic, strlen(topic));
+}
+
+TopicHandle::TopicHandle(const String & topic) : route(nullptr) {
+    TRACE_FUNCTION;
+    init(topic.c_str(), topic.length());
+}
+
+TopicHandle::TopicHandle(const TopicHandle & other) : route(nullptr) {
+    TRACE_FUNCTION;
+    init(other.c_str(), other.size());
+}
+
+TopicHandle::TopicHandle(TopicHandle && other)
+    : encoded(other.encoded), topic_size(other.topic_size), route(other.route) {
+    TRACE_FUNCTION;
+    other.encoded = nullptr;
+    other.route = nullptr;
+}
+
+TopicHandle::~TopicHandle() {
+    TRACE_FUNCTION;
+    delete route;
+    delete[] encoded;
+}
+
+void TopicHandle::init(const char * topic, size_t size) {
+    TRACE_FUNCTION;
+    topic_size = size;
+    encoded = new uint8_t[size + 3];
+    encoded[0] = size >> 8;
+    encoded[1] = size & 0xff;
+    memcpy(encoded + 2, topic, size);
+    encoded[size + 2] = '\0';
+}
+
+void TopicHandle::set_route(Route * new_route) const {
+    TRACE_FUNCTION;
+    delete route;
+    route = new_route;
+}
+
+}  // namespace PicoMQTT
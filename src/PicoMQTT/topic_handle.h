@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace PicoMQTT {
+
+/*
+ * A topic prepared for publishing many messages.  The handle stores the topic
+ * already encoded the way it appears in PUBLISH packets, publishers can
+ * additionally attach their own data to it (e.g. the broker caches the
+ * topic's recipients there).
+ *
+ * Handles are best created once and reused:
+ *
+ *   PicoMQTT::TopicHandle temperature = mqtt.topic("sensors/room1/temp");
+ *   // ...
+ *   mqtt.publish(temperature, "21.5");
+ */
+class TopicHandle {
+public:
+    // Base class for data attached by publishers
+    class Route {
+    public:
+        Route(const void * owner) : owner(owner) {}
+        virtual ~Route() {}
+
+        // the publisher which created the route
+        const void * const owner;
+    };
+
+    explicit TopicHandle(const char * topic);
+    explicit TopicHandle(const String & topic);
+    TopicHandle(const TopicHandle & other);
+    TopicHandle(TopicHandle && other);
+    ~TopicHandle();
+
+    const TopicHandle & operator=(const TopicHandle &) = delete;
+
+    const char * c_str() const { return (const char *)encoded + 2; }
+    size_t size() const { return topic_size; }
+
+    // Topic size (big endian) followed by the topic, as sent in packets
+    const uint8_t * get_encoded() const { return encoded; }
+    size_t get_encoded_size() const { return topic_size + 2; }
+
+    // Returns the route attached by the given publisher or null.
+    Route * get_route(const void * owner) const {
+        return (route && (route->owner == owner)) ? route : nullptr;
+    }
+
+    // Attaches a route, replacing the previous one.  The handle takes
+    // ownership of the route.
+    void set_route(Route * new_route) const;
+
+protected:
+    void init(const char * topic, size_t size);
+
+    // size, topic and a null terminator
+    uint8_t * encoded;
+    size_t topic_size;
+
+    mutable Route * route;
+};
+
+}  // namespace PicoMQTT
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "debug.h"
+
+namespace PicoMQTT {
+
+/*
+ * Open addressing hash table (with linear probing) mapping topics to values.
+ * Multiple values can be stored under the same topic.
+ *
+ * Keys are not copied, the caller must ensure that a key stays valid for as
+ * long as its entry is in the table.  Entries are removed by passing the same
+ * key pointer that was used to insert them.  The hash must be calculated
+ * using topic_hash().
+ */
+template <typename T>
+class TopicHashTable {
+public:
+    TopicHashTable() : entries(nullptr), capacity(0), used(0), live(0) {}
+    ~TopicHashTable() { delete[] entries; }
+
+    TopicHashTable(const TopicHashTable &) = delete;
+    const TopicHashTable & operator=(const TopicHashTable &) = delete;
+
+    void insert(const char * key, uint32_t hash, const T & value) {
+        TRACE_FUNCTION;
+        if ((used + 1) * 4 > capacity * 3) {
+            // grow (or just get rid of the tombstones)
+            size_t new_capacity = capacity ? capacity : 4;
+            while ((live + 1) * 2 > new_capacity) {
+                new_capacity *= 2;
+            }
+            rehash(new_capacity);
+        }
+
+        for (size_t i = hash & (capacity - 1);; i = (i + 1) & (capacity - 1)) {
+            Entry & entry = entries[i];
+            if (!entry.key || (entry.key == tombstone())) {
+                if (!entry.key) {
+                    ++used;
+                }
+                entry.key = key;
+                entry.hash = hash;
+                entry.value = value;
+                ++live;
+                return;
+            }
+        }
+    }
+
+    bool remove(const char * key, uint32_t hash, const T & value) {
+        TRACE_FUNCTION;
+        if (!capacity) {
+            return false;
+        }
+        for (size_t i = hash & (capacity - 1); entries[i].key;
+             i = (i + 1) & (capacity - 1)) {
+            Entry & entry = entries[i];
+            if ((entry.key == key) && (entry.value == value)) {
+                entry.key = tombstone();
+                --live;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Callback>
+    void find(const char * key, uint32_t hash, Callback && callback) const {
+        TRACE_FUNCTION;
+        if (!live) {
+            return;
+        }
+        for (size_t i = hash & (capacity - 1); entries[i].key;
+             i = (i + 1) & (capacity - 1)) {
+            const Entry & entry = entries[i];
+            if (entry.matches(key, hash)) {
+                callback(entry.value);
+            }
+        }
+    }
+
+    bool empty() const { return !live; }
+
+protected:
+    struct Entry {
+        Entry() : key(nullptr), hash(0), value() {}
+
+        bool matches(const char * other, uint32_t other_hash) const {
+            return (hash == other_hash) && (key != tombstone()) &&
+                   (strcmp(key, other) == 0);
+        }
+
+        const char * key;
+        uint32_t hash;
+        T value;
+    };
+
+    static const char * tombstone() {
+        static const char marker = '\0';
+        return &marker;
+    }
+
+    void rehash(size_t new_capacity) {
+        Entry * old_entries = entries;
+        const size_t old_capacity = capacity;
+
+        entries = new Entry[new_capacity];
+        capacity = new_capacity;
+        used = 0;
+        live = 0;
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            const Entry & entry = old_entries[i];
+            if (entry.key && (entry.key != tombstone())) {
+                insert(entry.key, entry.hash, entry.value);
+            }
+        }
+
+        delete[] old_entries;
+    }
+
+    Entry * entries;
+    size_t capacity;
+    size_t used;  // live entries and tombstones
+    size_t live;
+};
+
+}  // namespace PicoMQTT
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "debug.h"
+#include "topic_filter.h"
+#include "topic_hash_table.h"
+#include "topic_trie.h"
+
+namespace PicoMQTT {
+
+/*
+ * Maps topic filters to values.  Filters without wildcards are kept in a
+ * hash table, so matching a topic against them costs a single lookup.  Only
+ * filters with wildcards are stored in a trie.
+ *
+ * Filters must be compiled and must outlive their entries in the index.
+ */
+template <typename T>
+class TopicIndex {
+public:
+    void insert(const TopicFilter & filter, const T & value) {
+        TRACE_FUNCTION;
+        if (filter.is_literal()) {
+            literal.insert(filter.text.c_str(),
+                           filter.get_literal_prefix_hash(), value);
+        } else {
+            wildcard.insert(filter.text.c_str(), value);
+        }
+    }
+
+    bool remove(const TopicFilter & filter, const T & value) {
+        TRACE_FUNCTION;
+        if (filter.is_literal()) {
+            return literal.remove(filter.text.c_str(),
+                                  filter.get_literal_prefix_hash(), value);
+        } else {
+            return wildcard.remove(filter.text.c_str(), value);
+        }
+    }
+
+    template <typename Callback>
+    void match(const PreparedTopic & topic, Callback && callback) const {
+        TRACE_FUNCTION;
+        literal.find(topic.topic, topic.hash, callback);
+        if (!wildcard.empty()) {
+            wildcard.match(topic.topic, callback);
+        }
+    }
+
+protected:
+    TopicHashTable<T> literal;
+    TopicTrie<T> wildcard;
+};
+
+}  // namespace PicoMQTT
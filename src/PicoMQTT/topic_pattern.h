@@ -0,0 +1,215 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <array>
+#include <functional>
+
+#include "topic_filter.h"
+#include "topic_view.h"
+#include "utils.h"
+
+namespace PicoMQTT {
+
+/*
+ * Compile time topic filter parsing.  These functions are equivalent to
+ * Subscriber::is_valid_topic_filter() and friends, but they are written so
+ * that they can be evaluated by the compiler.
+ */
+
+constexpr bool topic_pattern_valid_level(const char * p);
+
+constexpr bool topic_pattern_valid_level_rest(const char * p) {
+    return (*p == '\0')   ? true
+           : (*p == '/')  ? topic_pattern_valid_level(p + 1)
+           : (*p == '+')  ? false
+           : (*p == '#')  ? false
+                          : topic_pattern_valid_level_rest(p + 1);
+}
+
+constexpr bool topic_pattern_valid_level(const char * p) {
+    return (*p == '+') ? ((p[1] == '\0') ||
+                          ((p[1] == '/') && topic_pattern_valid_level(p + 2)))
+           : (*p == '#') ? (p[1] == '\0')
+                         : topic_pattern_valid_level_rest(p);
+}
+
+constexpr bool topic_pattern_valid(const char * p) {
+    return p && (*p != '\0') && topic_pattern_valid_level(p);
+}
+
+constexpr size_t topic_pattern_count(const char * p, char c) {
+    return *p ? ((*p == c) ? 1 : 0) + topic_pattern_count(p + 1, c) : 0;
+}
+
+// Deliberately not constexpr.  Calling it in a constant expression causes a
+// compilation error, which points to the invalid topic pattern.
+size_t invalid_topic_pattern();
+
+constexpr size_t topic_pattern_wildcards(const char * p) {
+    return topic_pattern_valid(p) ? topic_pattern_count(p, '+')
+                                  : invalid_topic_pattern();
+}
+
+constexpr size_t topic_pattern_levels(const char * p) {
+    return topic_pattern_valid(p) ? topic_pattern_count(p, '/') + 1
+                                  : invalid_topic_pattern();
+}
+
+/*
+ * Topic filter validated and split into levels at compile time.  Matching
+ * topics against a pattern extracts the values of its single level ('+')
+ * wildcards without allocating memory.
+ *
+ * Patterns should be created using the PICOMQTT_TOPIC_PATTERN macro, which
+ * fills in the template parameters:
+ *
+ *   static constexpr auto pattern = PICOMQTT_TOPIC_PATTERN("home/+/temp");
+ *
+ * Parameter N is the number of '+' wildcards, L is the number of levels.
+ */
+template <size_t N, size_t L>
+class TopicPattern {
+public:
+    typedef std::array<TopicSegment, N> Captures;
+
+    // indices of the levels with the '+' wildcards
+    typedef std::array<size_t, N> Positions;
+
+    constexpr TopicPattern(const char * text)
+        : TopicPattern(text, typename MakeIndexSequence<L>::type()) {}
+
+    // Matches the topic and stores the values of the '+' wildcards in
+    // captures.  The captured segments point into the topic string.
+    bool match(const char * topic, Captures & captures) const {
+        size_t capture = 0;
+        const TopicView view(topic);
+        TopicView::Iterator it = view.begin();
+
+        for (size_t i = 0; i < L; ++i) {
+            const Level & level = levels[i];
+
+            if (level.type == TopicFilter::MULTI_LEVEL) {
+                return true;
+            }
+
+            if (it == view.end()) {
+                return false;
+            }
+
+            if (level.type == TopicFilter::SINGLE_LEVEL) {
+                captures[capture++] = *it;
+            } else if ((it->size != level.size) ||
+                       (memcmp(it->data, level.data, level.size) != 0)) {
+                return false;
+            }
+
+            ++it;
+        }
+
+        return it == view.end();
+    }
+
+    Positions get_wildcard_positions() const {
+        Positions positions;
+        size_t capture = 0;
+        for (size_t i = 0; i < L; ++i) {
+            if (levels[i].type == TopicFilter::SINGLE_LEVEL) {
+                positions[capture++] = i;
+            }
+        }
+        return positions;
+    }
+
+    // Stores the levels of the topic at the given positions in captures.
+    // Unlike match(), it doesn't compare the other levels, so it's only
+    // meaningful for topics already known to match the pattern.
+    static void capture(const char * topic, const Positions & positions,
+                        Captures & captures) {
+        if (!N) {
+            return;
+        }
+        size_t capture = 0;
+        size_t index = 0;
+        for (const TopicSegment & level : TopicView(topic)) {
+            if (index++ == positions[capture]) {
+                captures[capture] = level;
+                if (++capture == N) {
+                    return;
+                }
+            }
+        }
+    }
+
+    // Calls the callback with the captures expanded to separate arguments,
+    // followed by args.
+    template <typename Callback, typename... Args>
+    static void invoke(const Callback & callback, const Captures & captures,
+                       Args &&... args) {
+        invoke(callback, captures, typename MakeIndexSequence<N>::type(),
+               std::forward<Args>(args)...);
+    }
+
+    const char * const text;
+
+protected:
+    struct Level {
+        constexpr Level(const char * data, size_t size)
+            : data(data),
+              size(size),
+              type(((size == 1) && (*data == '+'))   ? TopicFilter::SINGLE_LEVEL
+                   : ((size == 1) && (*data == '#')) ? TopicFilter::MULTI_LEVEL
+                                                     : TopicFilter::LITERAL) {}
+
+        const char * data;
+        size_t size;
+        TopicFilter::SegmentType type;
+    };
+
+    static constexpr const char * level_start(const char * p, size_t index) {
+        return index ? level_start(next_level(p), index - 1) : p;
+    }
+
+    static constexpr const char * next_level(const char * p) {
+        return (*p == '/') ? p + 1 : next_level(p + 1);
+    }
+
+    static constexpr size_t level_size(const char * p) {
+        return ((*p == '\0') || (*p == '/')) ? 0 : 1 + level_size(p + 1);
+    }
+
+    static constexpr Level make_level(const char * start) {
+        return Level(start, level_size(start));
+    }
+
+    template <size_t... I>
+    constexpr TopicPattern(const char * text, IndexSequence<I...>)
+        : text(text), levels{make_level(level_start(text, I))...} {}
+
+    template <typename Callback, size_t... I, typename... Args>
+    static void invoke(const Callback & callback, const Captures & captures,
+                       IndexSequence<I...>, Args &&... args) {
+        callback(captures[I]..., std::forward<Args>(args)...);
+    }
+
+    const Level levels[L];
+};
+
+// std::function type taking N TopicSegment arguments followed by Args
+template <size_t N, typename... Args>
+struct TopicPatternCallback {
+    typedef typename TopicPatternCallback<N - 1, TopicSegment, Args...>::type
+        type;
+};
+
+template <typename... Args>
+struct TopicPatternCallback<0, Args...> {
+    typedef std::function<void(Args...)> type;
+};
+
+}  // namespace PicoMQTT
+
+#define PICOMQTT_TOPIC_PATTERN(filter)                           \
+    ::PicoMQTT::TopicPattern<                                    \
+        ::PicoMQTT::topic_pattern_wildcards(filter),             \
+        ::PicoMQTT::topic_pattern_levels(filter)>(filter)
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Topic scanning primitives and the topic matching and filter validation
+ * algorithms built on top of them.
+ *
+ * The algorithms look for separators and wildcards using a Scanner and
+ * compare whole topic levels with memcmp(), instead of looping over the
+ * characters one by one.  Scanners which process multiple bytes at a time
+ * are available on host builds (SSE2 on x86, 64-bit SWAR on other 64-bit
+ * little endian targets).  On the microcontrollers the scalar code in
+ * Subscriber is used instead.
+ *
+ * This header doesn't depend on Arduino, so it can be used in host
+ * benchmarks.
+ */
+
+#if UINTPTR_MAX == UINT64_MAX && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PICOMQTT_SWAR_TOPIC_SCANNER
+#endif
+
+#if defined(__SSE2__) || defined(PICOMQTT_SWAR_TOPIC_SCANNER)
+#define PICOMQTT_WIDE_TOPIC_SCANNER
+#endif
+
+// Wide scanners read whole aligned blocks, which may extend past the end of
+// the string (but never into another page).  This is safe, but address
+// sanitizers don't know that.
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+#define PICOMQTT_NO_SANITIZE_ADDRESS __attribute__((no_sanitize("address")))
+#else
+#define PICOMQTT_NO_SANITIZE_ADDRESS
+#endif
+
+namespace PicoMQTT {
+
+// Byte at a time scanner.
+struct ScalarTopicScanner {
+    // Returns a pointer to the first occurrence of a, b or the null
+    // terminator in s.
+    static const char * find(const char * s, char a, char b) {
+        while (*s && (*s != a) && (*s != b)) {
+            ++s;
+        }
+        return s;
+    }
+};
+
+#if defined(__SSE2__)
+
+struct Sse2TopicScanner {
+    PICOMQTT_NO_SANITIZE_ADDRESS
+    static const char * find(const char * s, char a, char b) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i va = _mm_set1_epi8(a);
+        const __m128i vb = _mm_set1_epi8(b);
+
+        const size_t misalignment = (uintptr_t)s & 15;
+        const char * block = s - misalignment;
+        unsigned int mask =
+            matches(block, zero, va, vb) & (0xffffu << misalignment);
+
+        while (!mask) {
+            block += 16;
+            mask = matches(block, zero, va, vb);
+        }
+
+        return block + __builtin_ctz(mask);
+    }
+
+protected:
+    PICOMQTT_NO_SANITIZE_ADDRESS
+    static unsigned int matches(const char * block, __m128i zero, __m128i va,
+                                __m128i vb) {
+        const __m128i data = _mm_load_si128((const __m128i *)block);
+        const __m128i found =
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(data, zero),
+                                      _mm_cmpeq_epi8(data, va)),
+                         _mm_cmpeq_epi8(data, vb));
+        return _mm_movemask_epi8(found);
+    }
+};
+
+#endif
+
+#if defined(PICOMQTT_SWAR_TOPIC_SCANNER)
+
+struct SwarTopicScanner {
+    PICOMQTT_NO_SANITIZE_ADDRESS
+    static const char * find(const char * s, char a, char b) {
+        const uint64_t va = broadcast(a);
+        const uint64_t vb = broadcast(b);
+
+        const size_t misalignment = (uintptr_t)s & 7;
+        const char * block = s - misalignment;
+        uint64_t mask = matches(block, va, vb) & (~0ull << (misalignment * 8));
+
+        while (!mask) {
+            block += 8;
+            mask = matches(block, va, vb);
+        }
+
+        return block + (__builtin_ctzll(mask) >> 3);
+    }
+
+protected:
+    static uint64_t broadcast(char c) {
+        return 0x0101010101010101ull * (uint8_t)c;
+    }
+
+    // Sets the high bit of every zero byte (without false positives, so
+    // bytes preceding the string can simply be masked out).
+    static uint64_t zero_bytes(uint64_t v) {
+        const uint64_t low_bits = 0x7f7f7f7f7f7f7f7full;
+        return ~(((v & low_bits) + low_bits) | v | low_bits);
+    }
+
+    PICOMQTT_NO_SANITIZE_ADDRESS
+    static uint64_t matches(const char * block, uint64_t va, uint64_t vb) {
+        uint64_t data;
+        memcpy(&data, __builtin_assume_aligned(block, 8), 8);
+        return zero_bytes(data) | zero_bytes(data ^ va) | zero_bytes(data ^ vb);
+    }
+};
+
+#endif
+
+#if defined(__SSE2__)
+typedef Sse2TopicScanner WideTopicScanner;
+#elif defined(PICOMQTT_SWAR_TOPIC_SCANNER)
+typedef SwarTopicScanner WideTopicScanner;
+#endif
+
+// Equivalent to Subscriber::is_valid_topic_filter()
+template <typename Scanner>
+bool scan_is_valid_topic_filter(const char * filter) {
+    if (!filter || !*filter) {
+        return false;
+    }
+
+    // Every string without wildcards is a valid filter, so it's enough to
+    // check the surroundings of the wildcards.
+    const char * p = filter;
+    while (*(p = Scanner::find(p, '+', '#'))) {
+        if ((p != filter) && (p[-1] != '/')) {
+            // wildcards must occupy entire topic segment
+            return false;
+        }
+        if (*p == '#') {
+            return p[1] == '\0';
+        }
+        if ((p[1] != '/') && (p[1] != '\0')) {
+            // single-level wildcard must be followed by topic separator
+            return false;
+        }
+        ++p;
+    }
+    return true;
+}
+
+// Equivalent to Subscriber::topic_matches() for valid filters.  The capture
+// callback is called with the start and the size of each topic level matched
+// by a '+' wildcard.
+template <typename Scanner, typename Capture>
+bool scan_topic_matches(const char * p, const char * t, Capture && capture) {
+    while (true) {
+        // compare the literal part of the filter up to the next wildcard
+        const char * wildcard = Scanner::find(p, '+', '#');
+        const size_t size = wildcard - p;
+        if (strncmp(p, t, size) != 0) {
+            // allow parent-topic match: "home/#" matches "home"
+            return (*wildcard == '#') && (size > 0) &&
+                   (strncmp(p, t, size - 1) == 0) && (t[size - 1] == '\0');
+        }
+        p = wildcard;
+        t += size;
+
+        switch (*p) {
+            case '\0':
+                return *t == '\0';
+            case '#':
+                return true;
+            default: {
+                // may match an empty level too: "home/+" matches "home/"
+                const char * level_end = Scanner::find(t, '/', '/');
+                capture(t, level_end - t);
+                t = level_end;
+                ++p;
+            }
+        }
+    }
+}
+
+}  // namespace PicoMQTT
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "debug.h"
+
+namespace PicoMQTT {
+
+/*
+ * Index of topic filters organized as a trie of topic segments.  Each filter
+ * maps to any number of values.  Looking up all values whose filters match a
+ * topic takes time proportional to the topic depth (and the number of
+ * wildcard branches visited), not to the total number of filters.
+ *
+ * Single level wildcards ('+') are stored as a dedicated child of a node.
+ * Multi-level wildcards ('#') are terminal, so instead of creating a child
+ * node, the values of filters ending with '#' are stored on the parent node.
+ * This naturally handles the parent-topic rule ("home/#" matches "home").
+ *
+ * Filters passed to insert() and remove() must be valid.
+ */
+template <typename T>
+class TopicTrie {
+public:
+    TopicTrie() {}
+    TopicTrie(const TopicTrie &) = delete;
+    const TopicTrie & operator=(const TopicTrie &) = delete;
+
+    void insert(const char * topic_filter, const T & value) {
+        TRACE_FUNCTION;
+        Node * node = &root;
+        while (true) {
+            const char * end = segment_end(topic_filter);
+            const size_t length = end - topic_filter;
+
+            if (length == 1 && topic_filter[0] == '#') {
+                node->multi_level_values.push_back(value);
+                return;
+            }
+
+            node = node->get_or_create_child(topic_filter, length);
+
+            if (!*end) {
+                node->values.push_back(value);
+                return;
+            }
+
+            topic_filter = end + 1;
+        }
+    }
+
+    bool remove(const char * topic_filter, const T & value) {
+        TRACE_FUNCTION;
+        return remove(root, topic_filter, value);
+    }
+
+    template <typename Callback>
+    void match(const char * topic, Callback && callback) const {
+        TRACE_FUNCTION;
+        match(root, topic, callback);
+    }
+
+    bool empty() const { return root.empty(); }
+
+protected:
+    struct Node {
+        Node() : plus(nullptr), children(nullptr), next(nullptr) {}
+        Node(const char * segment, size_t length)
+            : plus(nullptr), children(nullptr), next(nullptr) {
+            this->segment.concat(segment, length);
+        }
+
+        Node(const Node &) = delete;
+        const Node & operator=(const Node &) = delete;
+
+        ~Node() {
+            delete plus;
+            while (children) {
+                Node * child = children;
+                children = child->next;
+                delete child;
+            }
+        }
+
+        bool empty() const {
+            return values.empty() && multi_level_values.empty() && !plus &&
+                   !children;
+        }
+
+        bool segment_equals(const char * other, size_t length) const {
+            return (segment.length() == length) &&
+                   (memcmp(segment.c_str(), other, length) == 0);
+        }
+
+        Node * get_or_create_child(const char * segment, size_t length) {
+            if (length == 1 && segment[0] == '+') {
+                if (!plus) {
+                    plus = new Node();
+                }
+                return plus;
+            }
+
+            for (Node * child = children; child; child = child->next) {
+                if (child->segment_equals(segment, length)) {
+                    return child;
+                }
+            }
+
+            Node * child = new Node(segment, length);
+            child->next = children;
+            children = child;
+            return child;
+        }
+
+        String segment;
+        std::vector<T> values;
+        std::vector<T> multi_level_values;
+        Node * plus;
+        Node * children;
+        Node * next;
+    } root;
+
+    static const char * segment_end(const char * topic) {
+        while (*topic && *topic != '/') {
+            ++topic;
+        }
+        return topic;
+    }
+
+    static bool remove_value(std::vector<T> & values, const T & value) {
+        auto it = std::find(values.begin(), values.end(), value);
+        if (it == values.end()) {
+            return false;
+        }
+        values.erase(it);
+        return true;
+    }
+
+    static bool remove(Node & node, const char * topic_filter,
+                       const T & value) {
+        const char * end = segment_end(topic_filter);
+        const size_t length = end - topic_filter;
+
+        if (length == 1 && topic_filter[0] == '#') {
+            return remove_value(node.multi_level_values, value);
+        }
+
+        Node ** child = nullptr;
+        if (length == 1 && topic_filter[0] == '+') {
+            child = &node.plus;
+        } else {
+            for (child = &node.children; *child; child = &(*child)->next) {
+                if ((*child)->segment_equals(topic_filter, length)) {
+                    break;
+                }
+            }
+        }
+
+        if (!*child) {
+            return false;
+        }
+
+        const bool removed = *end ? remove(**child, end + 1, value)
+                                  : remove_value((*child)->values, value);
+
+        if ((*child)->empty()) {
+            // prune the branch, it's not needed anymore
+            Node * to_delete = *child;
+            *child = to_delete->next;
+            to_delete->next = nullptr;
+            delete to_delete;
+        }
+
+        return removed;
+    }
+
+    template <typename Callback>
+    static void match(const Node & node, const char * topic,
+                      Callback & callback) {
+        // '#' matches the remaining topic segments, including none at all
+        for (const T & value : node.multi_level_values) {
+            callback(value);
+        }
+
+        if (!topic) {
+            // all topic segments consumed
+            for (const T & value : node.values) {
+                callback(value);
+            }
+            return;
+        }
+
+        const char * end = segment_end(topic);
+        const size_t length = end - topic;
+        const char * next = *end ? end + 1 : nullptr;
+
+        for (const Node * child = node.children; child; child = child->next) {
+            if (child->segment_equals(topic, length)) {
+                match(*child, next, callback);
+                // segments of siblings are unique, so no other can match
+                break;
+            }
+        }
+
+        if (node.plus) {
+            match(*node.plus, next, callback);
+        }
+    }
+};
+
+}  // namespace PicoMQTT
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace PicoMQTT {
+
+// A topic level referencing the topic string, not null terminated.
+struct TopicSegment {
+    constexpr TopicSegment(const char * data = nullptr, size_t size = 0)
+        : data(data), size(size) {}
+
+    String to_string() const {
+        String ret;
+        ret.concat(data, size);
+        return ret;
+    }
+
+    bool operator==(const char * other) const {
+        return (strncmp(data, other, size) == 0) && (other[size] == '\0');
+    }
+
+    bool operator!=(const char * other) const { return !(*this == other); }
+
+    const char * data;
+    size_t size;
+};
+
+/*
+ * Splits a topic (or topic filter) into levels without copying.  Iterating
+ * over all levels scans the topic only once:
+ *
+ *   for (const PicoMQTT::TopicSegment & level : PicoMQTT::TopicView(topic)) {
+ *       // ...
+ *   }
+ *
+ * A topic with n separators always has n + 1 levels, some of which may be
+ * empty.
+ */
+class TopicView {
+public:
+    class Iterator {
+    public:
+        Iterator(const char * level = nullptr)
+            : segment(level, level ? level_size(level) : 0) {}
+
+        const TopicSegment & operator*() const { return segment; }
+        const TopicSegment * operator->() const { return &segment; }
+
+        Iterator & operator++() {
+            const char * separator = segment.data + segment.size;
+            *this = Iterator(*separator ? separator + 1 : nullptr);
+            return *this;
+        }
+
+        bool operator==(const Iterator & other) const {
+            return segment.data == other.segment.data;
+        }
+
+        bool operator!=(const Iterator & other) const {
+            return !(*this == other);
+        }
+
+    protected:
+        static size_t level_size(const char * level) {
+            const char * end = level;
+            while (*end && (*end != '/')) {
+                ++end;
+            }
+            return end - level;
+        }
+
+        TopicSegment segment;
+    };
+
+    TopicView(const char * topic) : topic(topic) {}
+
+    Iterator begin() const { return Iterator(topic); }
+    Iterator end() const { return Iterator(); }
+
+    // Returns the level with the given index (zero based) or an empty segment
+    // with null data if there are fewer levels.
+    TopicSegment operator[](size_t index) const {
+        for (const TopicSegment & level : *this) {
+            if (!index--) {
+                return level;
+            }
+        }
+        return TopicSegment();
+    }
+
+    const char * const topic;
+};
+
+}  // namespace PicoMQTT
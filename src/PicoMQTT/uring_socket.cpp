@@ -0,0 +1,737 @@
+#if defined(__linux__)
+
+#include "uring_socket.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace {
+
+// The user_data of each request holds the slot number and the operation
+enum Operation : uint64_t {
+    accept_operation = 0,
+    receive_operation = 1,
+    send_operation = 2,
+};
+
+const unsigned int operation_bits = 2;
+const uint64_t operation_mask = (1 << operation_bits) - 1;
+
+// number of accept requests kept in flight
+const unsigned int accept_depth = 8;
+
+uint64_t make_user_data(size_t slot, Operation operation) {
+    return ((uint64_t)slot << operation_bits) | operation;
+}
+
+// liburing isn't required, the raw system calls are used
+int io_uring_setup(unsigned int entries, io_uring_params * params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                   unsigned int flags, const void * arg, size_t arg_size) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   arg, arg_size);
+}
+
+int io_uring_register(int fd, unsigned int opcode, const void * arg,
+                      unsigned int nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+unsigned int load_acquire(const unsigned int * p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned int * p, unsigned int value) {
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+namespace PicoMQTT {
+
+UringClient::UringClient(UringServerSocket & server, size_t slot)
+    : write_timeout_millis(5 * 1000), server(server), slot(slot) {
+    TRACE_FUNCTION;
+}
+
+UringClient::~UringClient() {
+    TRACE_FUNCTION;
+    stop();
+}
+
+int UringClient::connect(IPAddress ip, uint16_t port) {
+    TRACE_FUNCTION;
+    return 0;
+}
+
+int UringClient::connect(const char * host, uint16_t port) {
+    TRACE_FUNCTION;
+    return 0;
+}
+
+#ifdef PICOMQTT_EXTRA_CONNECT_METHODS
+int UringClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    TRACE_FUNCTION;
+    return 0;
+}
+
+int UringClient::connect(const char * host, uint16_t port, int32_t timeout) {
+    TRACE_FUNCTION;
+    return 0;
+}
+#endif
+
+size_t UringClient::write(const uint8_t * buffer, size_t size) {
+    TRACE_FUNCTION;
+    const unsigned long start_millis = millis();
+    size_t ret = 0;
+
+    while ((slot != no_slot) && !server.slots[slot].hangup && (ret < size)) {
+        const int space = availableForWrite();
+        if (space <= 0) {
+            // send buffer full, wait until the kernel takes some data
+            const unsigned long elapsed_millis = millis() - start_millis;
+            if (elapsed_millis >= write_timeout_millis) {
+                break;
+            }
+            server.submit(true, write_timeout_millis - elapsed_millis);
+            continue;
+        }
+
+        UringServerSocket::Slot & s = server.slots[slot];
+        const size_t chunk_size =
+            (size - ret) < (size_t)space ? (size - ret) : (size_t)space;
+        memcpy(s.send_buffer + s.send_end, buffer + ret, chunk_size);
+        s.send_end += chunk_size;
+        ret += chunk_size;
+        server.queue(slot);
+    }
+
+    return ret;
+}
+
+size_t UringClient::write(uint8_t value) {
+    TRACE_FUNCTION;
+    return write(&value, 1);
+}
+
+int UringClient::availableForWrite() {
+    TRACE_FUNCTION;
+    if ((slot == no_slot) || server.slots[slot].hangup) {
+        return 0;
+    }
+
+    UringServerSocket::Slot & s = server.slots[slot];
+    if (!s.sending && s.send_begin) {
+        // nothing in flight, move the unsent data to the front
+        memmove(s.send_buffer, s.send_buffer + s.send_begin,
+                s.send_end - s.send_begin);
+        s.send_end -= s.send_begin;
+        s.send_begin = 0;
+    }
+
+    return PICOMQTT_URING_SEND_BUFFER_SIZE - s.send_end;
+}
+
+int UringClient::available() {
+    TRACE_FUNCTION;
+    if (slot == no_slot) {
+        return 0;
+    }
+
+    UringServerSocket::Slot & s = server.slots[slot];
+    if ((s.receive_begin == s.receive_end) && !s.hangup) {
+        if (s.idle_generation != server.get_generation()) {
+            // no data since the last poll(), the receive is still queued
+            s.idle_generation = server.get_generation();
+            return 0;
+        }
+
+        // Asked again before the next Server::loop(), probably while waiting
+        // for more data.  Submit the receive and check for completions.
+        server.poll();
+    }
+
+    return s.receive_end - s.receive_begin;
+}
+
+int UringClient::read(uint8_t * buf, size_t size) {
+    TRACE_FUNCTION;
+    if (slot == no_slot) {
+        return -1;
+    }
+
+    UringServerSocket::Slot & s = server.slots[slot];
+    const size_t buffered_size = s.receive_end - s.receive_begin;
+    if (!buffered_size) {
+        return -1;
+    }
+
+    const size_t ret = size < buffered_size ? size : buffered_size;
+    memcpy(buf, s.receive_buffer + s.receive_begin, ret);
+    s.receive_begin += ret;
+
+    if (s.receive_begin == s.receive_end) {
+        // drained, receive more on the next submit
+        s.receive_begin = s.receive_end = 0;
+        s.idle_generation = server.get_generation() - 1;
+        server.queue(slot);
+    }
+
+    return ret;
+}
+
+int UringClient::read() {
+    TRACE_FUNCTION;
+    uint8_t ret;
+    return read(&ret, 1) == 1 ? ret : -1;
+}
+
+int UringClient::peek() {
+    TRACE_FUNCTION;
+    if (slot == no_slot) {
+        return -1;
+    }
+    const UringServerSocket::Slot & s = server.slots[slot];
+    return s.receive_begin < s.receive_end ? s.receive_buffer[s.receive_begin]
+                                           : -1;
+}
+
+void UringClient::flush() {
+    TRACE_FUNCTION;
+    // data is sent in batches, see UringServerSocket::poll()
+}
+
+void UringClient::stop() {
+    TRACE_FUNCTION;
+    if (slot == no_slot) {
+        return;
+    }
+
+    // The server socket still sends whatever was written, e.g. a CONNACK
+    // rejecting the connection, without blocking.
+    server.release(slot, write_timeout_millis);
+    slot = no_slot;
+}
+
+uint8_t UringClient::connected() {
+    TRACE_FUNCTION;
+    if (slot == no_slot) {
+        return false;
+    }
+
+    // data received before the connection was closed can still be read
+    const UringServerSocket::Slot & s = server.slots[slot];
+    return !s.hangup || (s.receive_begin < s.receive_end);
+}
+
+UringClient::operator bool() { return slot != no_slot; }
+
+UringServerSocket::UringServerSocket(uint16_t port, const char * address,
+                                     size_t max_clients)
+    : port(port),
+      address(address),
+      max_clients(max_clients),
+      listen_fd(-1),
+      ring_fd(-1),
+      sq_ring(MAP_FAILED),
+      sq_ring_size(0),
+      sq_head(nullptr),
+      sq_tail(nullptr),
+      sq_flags(nullptr),
+      sq_array(nullptr),
+      sq_mask(0),
+      sq_entries(0),
+      sq_local_tail(0),
+      sqes((io_uring_sqe *)MAP_FAILED),
+      sqes_size(0),
+      cq_ring(MAP_FAILED),
+      cq_ring_size(0),
+      cq_head(nullptr),
+      cq_tail(nullptr),
+      cq_mask(0),
+      cqes(nullptr),
+      timeouts_supported(false),
+      buffers((uint8_t *)MAP_FAILED),
+      buffers_size(0),
+      buffers_registered(false),
+      accepts_in_flight(0),
+      generation(0),
+      enter_count(0) {
+    TRACE_FUNCTION;
+}
+
+UringServerSocket::~UringServerSocket() {
+    TRACE_FUNCTION;
+    // closing the ring cancels all requests in flight
+    close_ring();
+
+    for (const Slot & s : slots) {
+        if (s.in_use) {
+            close(s.fd);
+        }
+    }
+
+    for (int fd : accepted) {
+        close(fd);
+    }
+
+    if (buffers != MAP_FAILED) {
+        munmap(buffers, buffers_size);
+    }
+
+    if (listen_fd >= 0) {
+        close(listen_fd);
+    }
+}
+
+bool UringServerSocket::setup_ring() {
+    TRACE_FUNCTION;
+    // each connection has up to one receive and one send in flight
+    const size_t entries = 2 * max_clients + accept_depth;
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE;
+    params.cq_entries = 2 * entries;
+
+    ring_fd = io_uring_setup(entries, &params);
+    if (ring_fd < 0) {
+        return false;
+    }
+
+    timeouts_supported = params.features & IORING_FEAT_EXT_ARG;
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && (cq_ring_size > sq_ring_size)) {
+        sq_ring_size = cq_ring_size;
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        return false;
+    }
+
+    if (!single_mmap) {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            return false;
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe *)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring_fd,
+                                IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+
+    uint8_t * sq = (uint8_t *)sq_ring;
+    sq_head = (unsigned *)(sq + params.sq_off.head);
+    sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    sq_flags = (unsigned *)(sq + params.sq_off.flags);
+    sq_array = (unsigned *)(sq + params.sq_off.array);
+    sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    sq_local_tail = *sq_tail;
+
+    uint8_t * cq = (uint8_t *)(single_mmap ? sq_ring : cq_ring);
+    cq_head = (unsigned *)(cq + params.cq_off.head);
+    cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+void UringServerSocket::close_ring() {
+    TRACE_FUNCTION;
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqes_size);
+        sqes = (io_uring_sqe *)MAP_FAILED;
+    }
+    if (cq_ring != MAP_FAILED) {
+        munmap(cq_ring, cq_ring_size);
+        cq_ring = MAP_FAILED;
+    }
+    if (sq_ring != MAP_FAILED) {
+        munmap(sq_ring, sq_ring_size);
+        sq_ring = MAP_FAILED;
+    }
+    if (ring_fd >= 0) {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+}
+
+void UringServerSocket::begin() {
+    TRACE_FUNCTION;
+    if (ring_fd >= 0) {
+        return;
+    }
+
+    // accepts go through io_uring, the listening socket can block
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        return;
+    }
+
+    const int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (address) {
+        inet_pton(AF_INET, address, &addr.sin_addr);
+    }
+
+    const size_t slot_size =
+        PICOMQTT_URING_RECEIVE_BUFFER_SIZE + PICOMQTT_URING_SEND_BUFFER_SIZE;
+    buffers_size = max_clients * slot_size;
+    buffers = (uint8_t *)mmap(nullptr, buffers_size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (bind(listen_fd, (const sockaddr *)&addr, sizeof(addr)) ||
+        listen(listen_fd, SOMAXCONN) || (buffers == MAP_FAILED) ||
+        !setup_ring()) {
+        close_ring();
+        close(listen_fd);
+        listen_fd = -1;
+        return;
+    }
+
+    // Registering pins the buffers in memory, so the kernel doesn't have to
+    // map them for every request.  It can fail, e.g. if RLIMIT_MEMLOCK is too
+    // low, plain receives and sends are used then.
+    iovec iov = {buffers, buffers_size};
+    buffers_registered =
+        !io_uring_register(ring_fd, IORING_REGISTER_BUFFERS, &iov, 1);
+
+    slots.resize(max_clients);
+    for (size_t i = 0; i < max_clients; ++i) {
+        Slot & s = slots[i];
+        memset(&s, 0, sizeof(s));
+        s.fd = -1;
+        s.receive_buffer = buffers + i * slot_size;
+        s.send_buffer = s.receive_buffer + PICOMQTT_URING_RECEIVE_BUFFER_SIZE;
+        free_slots.push_back(max_clients - 1 - i);
+    }
+
+    submit();
+}
+
+void UringServerSocket::queue(size_t slot) {
+    TRACE_FUNCTION;
+    Slot & s = slots[slot];
+    if (!s.queued) {
+        s.queued = true;
+        queued_slots.push_back(slot);
+    }
+}
+
+io_uring_sqe * UringServerSocket::get_sqe() {
+    TRACE_FUNCTION;
+    while (sq_local_tail - load_acquire(sq_head) >= sq_entries) {
+        // the queue is full, submit what's there to make room
+        store_release(sq_tail, sq_local_tail);
+        ++enter_count;
+        if ((io_uring_enter(ring_fd, sq_local_tail - *sq_head, 0, 0, nullptr,
+                            0) < 0) &&
+            (errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) {
+            return nullptr;
+        }
+    }
+
+    const unsigned int index = sq_local_tail & sq_mask;
+    sq_array[index] = index;
+    ++sq_local_tail;
+
+    io_uring_sqe * sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void UringServerSocket::prepare_accepts() {
+    TRACE_FUNCTION;
+    // Connections which don't fit are closed as soon as they're accepted, no
+    // need to hold them in the backlog.
+    while ((listen_fd >= 0) && (accepts_in_flight < accept_depth)) {
+        io_uring_sqe * sqe = get_sqe();
+        if (!sqe) {
+            return;
+        }
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = make_user_data(0, accept_operation);
+        ++accepts_in_flight;
+    }
+}
+
+void UringServerSocket::prepare(size_t slot) {
+    TRACE_FUNCTION;
+    Slot & s = slots[slot];
+    s.queued = false;
+
+    if (!s.in_use) {
+        return;
+    }
+
+    if (s.closing && !s.receiving && !s.sending &&
+        (s.hangup || (s.send_begin == s.send_end))) {
+        // everything sent (or the connection failed)
+        free_slot(slot);
+        return;
+    }
+
+    if (!s.closing && !s.receiving && !s.hangup &&
+        (s.receive_begin == s.receive_end)) {
+        io_uring_sqe * sqe = get_sqe();
+        if (!sqe) {
+            return;
+        }
+        if (buffers_registered) {
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->buf_index = 0;
+        } else {
+            sqe->opcode = IORING_OP_RECV;
+        }
+        sqe->fd = s.fd;
+        sqe->off = (uint64_t)-1;
+        sqe->addr = (uint64_t)s.receive_buffer;
+        sqe->len = PICOMQTT_URING_RECEIVE_BUFFER_SIZE;
+        sqe->user_data = make_user_data(slot, receive_operation);
+        s.receiving = true;
+    }
+
+    if (!s.sending && !s.hangup && (s.send_begin < s.send_end)) {
+        io_uring_sqe * sqe = get_sqe();
+        if (!sqe) {
+            return;
+        }
+        // Plain sends can't use the registered buffers, only zero copy sends
+        // can, which don't pay off for small packets.  IORING_OP_WRITE_FIXED
+        // would raise SIGPIPE on closed connections.
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = s.fd;
+        sqe->addr = (uint64_t)(s.send_buffer + s.send_begin);
+        sqe->len = s.send_end - s.send_begin;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = make_user_data(slot, send_operation);
+        s.sending = true;
+    }
+}
+
+void UringServerSocket::submit(bool wait, unsigned long timeout_millis) {
+    TRACE_FUNCTION;
+    if (ring_fd < 0) {
+        return;
+    }
+
+    prepare_accepts();
+
+    // prepare() never queues slots, the list doesn't change in this loop
+    for (size_t i = 0; i < queued_slots.size(); ++i) {
+        prepare(queued_slots[i]);
+    }
+    queued_slots.clear();
+
+    const unsigned int to_submit = sq_local_tail - load_acquire(sq_head);
+    store_release(sq_tail, sq_local_tail);
+
+    // The kernel sets IORING_SQ_CQ_OVERFLOW if completions didn't fit in the
+    // completion queue, they're flushed by io_uring_enter().
+    const bool overflow =
+        load_acquire(sq_flags) & (IORING_SQ_CQ_OVERFLOW | IORING_SQ_TASKRUN);
+
+    if (to_submit || wait || overflow) {
+        unsigned int flags = (wait || overflow) ? IORING_ENTER_GETEVENTS : 0;
+        __kernel_timespec timeout = {0, 0};
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        const void * arg_ptr = nullptr;
+        size_t arg_size = 0;
+
+        if (wait && timeouts_supported) {
+            timeout.tv_sec = timeout_millis / 1000;
+            timeout.tv_nsec = (timeout_millis % 1000) * 1000000;
+            arg.ts = (uint64_t)&timeout;
+            arg_ptr = &arg;
+            arg_size = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+
+        ++enter_count;
+        io_uring_enter(ring_fd, to_submit, wait ? 1 : 0, flags, arg_ptr,
+                       arg_size);
+    }
+
+    reap();
+}
+
+void UringServerSocket::reap() {
+    TRACE_FUNCTION;
+    unsigned int head = *cq_head;
+    const unsigned int tail = load_acquire(cq_tail);
+    while (head != tail) {
+        const io_uring_cqe & cqe = cqes[head & cq_mask];
+        complete(cqe.user_data, cqe.res);
+        ++head;
+    }
+    store_release(cq_head, head);
+}
+
+void UringServerSocket::complete(uint64_t user_data, int32_t result) {
+    TRACE_FUNCTION;
+    const size_t slot = user_data >> operation_bits;
+
+    switch (user_data & operation_mask) {
+        case accept_operation:
+            --accepts_in_flight;
+            if (result >= 0) {
+                accepted.push_back(result);
+            }
+            return;
+
+        case receive_operation: {
+            Slot & s = slots[slot];
+            s.receiving = false;
+            if (s.closing) {
+                // ended by release(), nobody reads the data anymore
+            } else if (result > 0) {
+                s.receive_begin = 0;
+                s.receive_end = result;
+            } else if ((result == 0) ||
+                       ((result != -EINTR) && (result != -EAGAIN))) {
+                // connection closed by peer or failed
+                s.hangup = true;
+            }
+            queue(slot);
+            return;
+        }
+
+        case send_operation: {
+            Slot & s = slots[slot];
+            s.sending = false;
+            if (result > 0) {
+                s.send_begin += result;
+                if (s.send_begin == s.send_end) {
+                    s.send_begin = s.send_end = 0;
+                }
+            } else if ((result != -EINTR) && (result != -EAGAIN)) {
+                // connection failed, drop the unsent data
+                s.hangup = true;
+                s.send_begin = s.send_end = 0;
+            }
+            queue(slot);
+            return;
+        }
+    }
+}
+
+void UringServerSocket::release(size_t slot, unsigned long timeout_millis) {
+    TRACE_FUNCTION;
+    Slot & s = slots[slot];
+    s.closing = true;
+    s.receive_begin = s.receive_end = 0;
+
+    if (!s.hangup && (s.send_begin < s.send_end)) {
+        // Keep sending, but make the kernel abort the connection if the peer
+        // doesn't take the data in time.  That fails the send in flight.
+        const unsigned int timeout = timeout_millis;
+        setsockopt(s.fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout,
+                   sizeof(timeout));
+        // completes the receive in flight
+        shutdown(s.fd, SHUT_RD);
+    } else {
+        s.send_begin = s.send_end = 0;
+        if (s.receiving || s.sending) {
+            // completes the requests in flight
+            shutdown(s.fd, SHUT_RDWR);
+        }
+    }
+
+    // the slot is freed once no requests are in flight
+    queue(slot);
+}
+
+void UringServerSocket::free_slot(size_t slot) {
+    TRACE_FUNCTION;
+    Slot & s = slots[slot];
+    close(s.fd);
+    s.fd = -1;
+    s.in_use = false;
+    s.closing = false;
+    s.hangup = false;
+    free_slots.push_back(slot);
+}
+
+void UringServerSocket::poll() {
+    TRACE_FUNCTION;
+    ++generation;
+    submit();
+}
+
+::Client * UringServerSocket::accept_client() {
+    TRACE_FUNCTION;
+    while (!accepted.empty()) {
+        const int fd = accepted.front();
+        accepted.pop_front();
+
+        if (free_slots.empty()) {
+            // too many connections
+            close(fd);
+            continue;
+        }
+
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        const size_t slot = free_slots.back();
+        free_slots.pop_back();
+
+        Slot & s = slots[slot];
+        s.fd = fd;
+        s.in_use = true;
+        s.closing = false;
+        s.hangup = false;
+        s.receiving = false;
+        s.receive_begin = s.receive_end = 0;
+        s.sending = false;
+        s.send_begin = s.send_end = 0;
+        s.idle_generation = generation;
+
+        // the first receive is submitted with the next batch
+        queue(slot);
+
+        return new UringClient(*this, slot);
+    }
+
+    return nullptr;
+}
+
+}  // namespace PicoMQTT
+
+#endif
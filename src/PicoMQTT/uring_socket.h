@@ -0,0 +1,200 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include <deque>
+#include <vector>
+
+#include "config.h"
+#include "debug.h"
+#include "server.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace PicoMQTT {
+
+class UringServerSocket;
+
+/*
+ * Connection accepted by a UringServerSocket.  Reads and writes only copy data
+ * from and to the connection's buffers.  The receives and sends are queued
+ * and submitted by the server socket, all connections at once, in one system
+ * call per Server::loop() call.
+ *
+ * Writes only block if the send buffer is full, until the kernel takes some
+ * of the data (or write_timeout_millis passes).
+ */
+class UringClient : public ::Client {
+public:
+    UringClient(UringServerSocket & server, size_t slot);
+    virtual ~UringClient();
+
+    UringClient(const UringClient &) = delete;
+    const UringClient & operator=(const UringClient &) = delete;
+
+    // these are for outgoing connections, which aren't supported
+    virtual int connect(IPAddress ip, uint16_t port) override;
+    virtual int connect(const char * host, uint16_t port) override;
+#ifdef PICOMQTT_EXTRA_CONNECT_METHODS
+    virtual int connect(IPAddress ip, uint16_t port, int32_t timeout) override;
+    virtual int connect(const char * host, uint16_t port,
+                        int32_t timeout) override;
+#endif
+
+    virtual size_t write(const uint8_t * buffer, size_t size) override;
+    virtual size_t write(uint8_t value) override;
+    virtual int availableForWrite() override;
+    virtual int available() override;
+    virtual int read(uint8_t * buf, size_t size) override;
+    virtual int read() override;
+    virtual int peek() override;
+    virtual void flush() override;
+    virtual void stop() override;
+    virtual uint8_t connected() override;
+    virtual operator bool() override;
+
+    unsigned long write_timeout_millis;
+
+protected:
+    UringServerSocket & server;
+
+    // index of the connection's slot in the server socket, or no_slot after
+    // stop()
+    size_t slot;
+    static const size_t no_slot = (size_t)-1;
+};
+
+/*
+ * Listening socket for the broker, built on io_uring.  Accepts, receives and
+ * sends of all connections are queued and submitted with a single
+ * io_uring_enter() call in poll(), which also collects their completions
+ * from the shared ring without a system call.  Idle connections cost
+ * nothing: their receive stays queued in the kernel until data arrives.
+ *
+ * Each connection gets a slot with a receive and a send buffer (see
+ * PICOMQTT_URING_RECEIVE_BUFFER_SIZE and PICOMQTT_URING_SEND_BUFFER_SIZE),
+ * carved from one block of memory registered with the kernel.  Receives use
+ * the registration, so the kernel doesn't map the buffers for every request.
+ * At most max_clients connections are served at once, further ones are
+ * closed right after they're accepted.
+ */
+class UringServerSocket : public ServerSocketInterface {
+public:
+    UringServerSocket(uint16_t port = 1883, const char * address = nullptr,
+                      size_t max_clients = 256);
+    virtual ~UringServerSocket();
+
+    UringServerSocket(const UringServerSocket &) = delete;
+    const UringServerSocket & operator=(const UringServerSocket &) = delete;
+
+    virtual void begin() override;
+    virtual void poll() override;
+    virtual ::Client * accept_client() override;
+
+    // incremented by every poll()
+    unsigned long get_generation() const { return generation; }
+
+    // number of io_uring_enter() calls
+    unsigned long get_enter_count() const { return enter_count; }
+
+protected:
+    friend class UringClient;
+
+    struct Slot {
+        int fd;
+        bool in_use;
+        bool closing;  // the UringClient is gone, sending what's left
+        bool queued;   // on the list of slots to prepare requests for
+        bool hangup;   // the peer closed the connection or it failed
+
+        bool receiving;  // a receive request is in flight
+        uint8_t * receive_buffer;
+        size_t receive_begin;
+        size_t receive_end;
+
+        bool sending;  // a send request is in flight
+        uint8_t * send_buffer;
+        size_t send_begin;
+        size_t send_end;
+
+        // the poll() generation in which the connection was last found idle
+        unsigned long idle_generation;
+    };
+
+    bool setup_ring();
+    void close_ring();
+
+    // Marks the slot as needing requests, they're prepared on the next
+    // submit()
+    void queue(size_t slot);
+
+    io_uring_sqe * get_sqe();
+    void prepare_accepts();
+    void prepare(size_t slot);
+
+    // Submits all queued requests and collects completions.  With wait set,
+    // blocks for up to timeout_millis until something completes.
+    void submit(bool wait = false, unsigned long timeout_millis = 0);
+    void reap();
+    void complete(uint64_t user_data, int32_t result);
+
+    // Called by the UringClient when it's stopped.  Data left in the send
+    // buffer is still sent, for up to timeout_millis.  The slot is freed when
+    // no requests are in flight anymore.
+    void release(size_t slot, unsigned long timeout_millis);
+    void free_slot(size_t slot);
+
+    uint16_t port;
+    const char * address;
+    size_t max_clients;
+
+    int listen_fd;
+    int ring_fd;
+
+    // submission queue
+    void * sq_ring;
+    size_t sq_ring_size;
+    unsigned * sq_head;
+    unsigned * sq_tail;
+    unsigned * sq_flags;
+    unsigned * sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;  // including prepared, not yet submitted entries
+    io_uring_sqe * sqes;
+    size_t sqes_size;
+
+    // completion queue
+    void * cq_ring;
+    size_t cq_ring_size;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe * cqes;
+
+    bool timeouts_supported;
+
+    // connection buffers
+    uint8_t * buffers;
+    size_t buffers_size;
+    bool buffers_registered;
+
+    std::vector<Slot> slots;
+    std::vector<size_t> free_slots;
+    std::vector<size_t> queued_slots;
+
+    // accepted connections, not yet returned by accept_client()
+    std::deque<int> accepted;
+    unsigned int accepts_in_flight;
+
+    unsigned long generation;
+    unsigned long enter_count;
+};
+
+}  // namespace PicoMQTT
+
+#endif
@@ -1,9 +1,23 @@
 #pragma once
 
+#include <stddef.h>
+
 #include <utility>
 
 namespace PicoMQTT {
 
+// C++11 replacement for std::index_sequence and std::make_index_sequence
+template <size_t... I>
+struct IndexSequence {};
+
+template <size_t N, size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct MakeIndexSequence<0, I...> {
+    typedef IndexSequence<I...> type;
+};
+
 template <typename T>
 struct SocketOwner {
     SocketOwner() {}
@@ -0,0 +1,53 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "PicoMQTT/buffer_pool.h"
+
+using PicoMQTT::BufferPool;
+
+void test_block_is_reused() {
+    BufferPool pool(64);
+    uint8_t * first = pool.acquire();
+    TEST_ASSERT_NOT_NULL(first);
+    pool.release(first);
+    TEST_ASSERT_EQUAL_PTR(first, pool.acquire());
+    pool.release(first);
+}
+
+void test_extra_blocks() {
+    BufferPool pool(64);
+    uint8_t * first = pool.acquire();
+    uint8_t * second = pool.acquire();
+    TEST_ASSERT_NOT_NULL(second);
+    TEST_ASSERT_TRUE(first != second);
+    pool.release(second);
+    pool.release(first);
+    TEST_ASSERT_EQUAL_PTR(first, pool.acquire());
+    pool.release(first);
+}
+
+void test_zero_size() {
+    BufferPool pool(0);
+    TEST_ASSERT_NULL(pool.acquire());
+    pool.set_block_size(16);
+    TEST_ASSERT_EQUAL(16, pool.get_block_size());
+    uint8_t * block = pool.acquire();
+    TEST_ASSERT_NOT_NULL(block);
+
+    // blocks in use when the size changes are freed on release
+    pool.set_block_size(0);
+    pool.release(block);
+    TEST_ASSERT_NULL(pool.acquire());
+}
+
+void setup() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_block_is_reused);
+    RUN_TEST(test_extra_blocks);
+    RUN_TEST(test_zero_size);
+
+    UNITY_END();
+}
+
+void loop() {}
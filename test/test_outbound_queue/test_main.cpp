@@ -0,0 +1,150 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "PicoMQTT/outbound_queue.h"
+
+using PicoMQTT::OutboundQueue;
+using PicoMQTT::SharedBuffer;
+
+static const char * pop_all(OutboundQueue & queue) {
+    static char ret[64];
+    size_t pos = 0;
+    while (!queue.empty()) {
+        const size_t size = queue.front_size();
+        memcpy(ret + pos, queue.front(), size);
+        pos += size;
+        queue.pop(size);
+    }
+    ret[pos] = '\0';
+    return ret;
+}
+
+void test_disabled() {
+    OutboundQueue queue;
+    TEST_ASSERT_FALSE(queue.push((const uint8_t *)"abc", 3));
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_copies_are_merged() {
+    OutboundQueue queue;
+    queue.reserve(100, 4);
+    TEST_ASSERT_TRUE(queue.push((const uint8_t *)"abc", 3));
+    TEST_ASSERT_TRUE(queue.push((const uint8_t *)"def", 3));
+    TEST_ASSERT_EQUAL(6, queue.size());
+    TEST_ASSERT_EQUAL(6, queue.front_size());
+    queue.pop(2);
+    TEST_ASSERT_EQUAL(4, queue.size());
+    TEST_ASSERT_EQUAL_STRING("cdef", pop_all(queue));
+    TEST_ASSERT_EQUAL(0, queue.size());
+}
+
+void test_shared_buffers() {
+    SharedBuffer buffer(4);
+    memcpy(buffer.data(), "1234", 4);
+
+    OutboundQueue queue;
+    queue.reserve(100, 4);
+    TEST_ASSERT_TRUE(queue.push((const uint8_t *)"ab", 2));
+    TEST_ASSERT_TRUE(queue.push(buffer));
+    TEST_ASSERT_TRUE(queue.push(buffer, 2));
+    TEST_ASSERT_EQUAL(3, buffer.use_count());
+    // copies must not be merged into shared buffers
+    TEST_ASSERT_TRUE(queue.push((const uint8_t *)"cd", 2));
+    TEST_ASSERT_EQUAL(10, queue.size());
+    TEST_ASSERT_EQUAL_STRING("ab123434cd", pop_all(queue));
+    TEST_ASSERT_EQUAL(1, buffer.use_count());
+}
+
+void test_limits() {
+    OutboundQueue queue;
+    queue.reserve(20, 2);
+    TEST_ASSERT_FALSE(queue.push((const uint8_t *)"0123456789abcdefghijk", 21));
+    TEST_ASSERT_TRUE(queue.push((const uint8_t *)"0123456", 7));
+
+    SharedBuffer buffer(3);
+    memcpy(buffer.data(), "abc", 3);
+    TEST_ASSERT_TRUE(queue.push(buffer));
+
+    // out of slots
+    TEST_ASSERT_FALSE(queue.push(buffer));
+    TEST_ASSERT_FALSE(queue.push((const uint8_t *)"x", 1));
+    TEST_ASSERT_EQUAL(10, queue.size());
+
+    // the ring wraps around
+    queue.pop(7);
+    TEST_ASSERT_TRUE(queue.push((const uint8_t *)"xyz", 3));
+    TEST_ASSERT_EQUAL(6, queue.size());
+
+    // out of space
+    TEST_ASSERT_FALSE(queue.push((const uint8_t *)"0123456789abcdef", 16));
+    TEST_ASSERT_EQUAL_STRING("abcxyz", pop_all(queue));
+}
+
+void test_drop_oldest() {
+    SharedBuffer first(2), second(3);
+    memcpy(first.data(), "ab", 2);
+    memcpy(second.data(), "cde", 3);
+
+    OutboundQueue queue;
+    queue.reserve(100, 4);
+    TEST_ASSERT_TRUE(queue.push(first));
+    TEST_ASSERT_TRUE(queue.push((const uint8_t *)"xy", 2));
+    TEST_ASSERT_TRUE(queue.push(second));
+
+    // packets which were partially sent and copied data are kept
+    queue.pop(1);
+    TEST_ASSERT_EQUAL(3, queue.drop_oldest());
+    TEST_ASSERT_EQUAL(0, queue.drop_oldest());
+    TEST_ASSERT_EQUAL(3, queue.size());
+    TEST_ASSERT_EQUAL_STRING("bxy", pop_all(queue));
+}
+
+static SharedBuffer publish(const char * topic, const char * payload) {
+    const size_t topic_size = strlen(topic);
+    const size_t payload_size = strlen(payload);
+    SharedBuffer ret(4 + topic_size + payload_size);
+    uint8_t * data = ret.data();
+    data[0] = 0x30;
+    data[1] = 2 + topic_size + payload_size;
+    data[2] = 0;
+    data[3] = topic_size;
+    memcpy(data + 4, topic, topic_size);
+    memcpy(data + 4 + topic_size, payload, payload_size);
+    return ret;
+}
+
+void test_replace() {
+    OutboundQueue queue;
+    queue.reserve(100, 4);
+    TEST_ASSERT_FALSE(queue.replace(publish("a", "1")));
+    TEST_ASSERT_TRUE(queue.push(publish("a", "1")));
+    TEST_ASSERT_TRUE(queue.push(publish("b", "1")));
+    TEST_ASSERT_TRUE(queue.replace(publish("b", "22")));
+    TEST_ASSERT_TRUE(queue.replace(publish("a", "333")));
+    TEST_ASSERT_FALSE(queue.replace(publish("c", "1")));
+    TEST_ASSERT_EQUAL(15, queue.size());
+
+    // packets which were partially sent already aren't replaced
+    queue.pop(1);
+    TEST_ASSERT_FALSE(queue.replace(publish("a", "4")));
+    TEST_ASSERT_EQUAL(7, queue.front_size());
+    TEST_ASSERT_EQUAL_MEMORY("a333", queue.front() + 3, 4);
+    queue.pop(7);
+    TEST_ASSERT_EQUAL(7, queue.front_size());
+    TEST_ASSERT_EQUAL_MEMORY("b22", queue.front() + 4, 3);
+}
+
+void setup() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_disabled);
+    RUN_TEST(test_copies_are_merged);
+    RUN_TEST(test_shared_buffers);
+    RUN_TEST(test_limits);
+    RUN_TEST(test_drop_oldest);
+    RUN_TEST(test_replace);
+
+    UNITY_END();
+}
+
+void loop() {}
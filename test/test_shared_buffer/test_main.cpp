@@ -0,0 +1,59 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "PicoMQTT/shared_buffer.h"
+
+using PicoMQTT::SharedBuffer;
+
+void test_empty() {
+    SharedBuffer buffer;
+    TEST_ASSERT_FALSE(buffer);
+    TEST_ASSERT_NULL(buffer.data());
+    TEST_ASSERT_EQUAL(0, buffer.size());
+    TEST_ASSERT_EQUAL(0, buffer.use_count());
+}
+
+void test_copies_share_data() {
+    SharedBuffer buffer(16);
+    TEST_ASSERT_TRUE(buffer);
+    TEST_ASSERT_EQUAL(16, buffer.size());
+    TEST_ASSERT_EQUAL(1, buffer.use_count());
+    memcpy(buffer.data(), "0123456789abcdef", 16);
+
+    SharedBuffer copy(buffer);
+    TEST_ASSERT_EQUAL(2, buffer.use_count());
+    TEST_ASSERT_EQUAL_PTR(buffer.data(), copy.data());
+
+    {
+        SharedBuffer assigned;
+        assigned = copy;
+        TEST_ASSERT_EQUAL(3, buffer.use_count());
+    }
+    TEST_ASSERT_EQUAL(2, buffer.use_count());
+
+    buffer.reset();
+    TEST_ASSERT_FALSE(buffer);
+    TEST_ASSERT_EQUAL(1, copy.use_count());
+    TEST_ASSERT_EQUAL_MEMORY("0123456789abcdef", copy.data(), 16);
+}
+
+void test_move() {
+    SharedBuffer buffer(8);
+    const uint8_t * data = buffer.data();
+    SharedBuffer moved(std::move(buffer));
+    TEST_ASSERT_FALSE(buffer);
+    TEST_ASSERT_EQUAL_PTR(data, moved.data());
+    TEST_ASSERT_EQUAL(1, moved.use_count());
+}
+
+void setup() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_empty);
+    RUN_TEST(test_copies_share_data);
+    RUN_TEST(test_move);
+
+    UNITY_END();
+}
+
+void loop() {}
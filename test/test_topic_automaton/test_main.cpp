@@ -0,0 +1,139 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "PicoMQTT/subscriber.h"
+#include "PicoMQTT/topic_automaton.h"
+
+using PicoMQTT::SubscribedMessageListener;
+using PicoMQTT::TopicAutomaton;
+
+static unsigned int match(TopicAutomaton<int> & automaton,
+                          const char * topic) {
+    unsigned int ret = 0;
+    automaton.match(topic, [&ret](int value) { ret |= 1 << value; });
+    return ret;
+}
+
+void test_literal_and_wildcards() {
+    TopicAutomaton<int> automaton;
+    automaton.insert("home/+/temp", 0);
+    automaton.insert("home/#", 1);
+    automaton.insert("#", 2);
+    automaton.insert("+/status", 3);
+    automaton.insert("home/kitchen/temp", 4);
+    TEST_ASSERT_EQUAL(0b10111, match(automaton, "home/kitchen/temp"));
+    TEST_ASSERT_EQUAL(0b00111, match(automaton, "home/hall/temp"));
+    TEST_ASSERT_EQUAL(0b00110, match(automaton, "home/kitchen/inside/temp"));
+    TEST_ASSERT_EQUAL(0b00110, match(automaton, "home"));
+    TEST_ASSERT_EQUAL(0b00110, match(automaton, "home/"));
+    TEST_ASSERT_EQUAL(0b01110, match(automaton, "home/status"));
+    TEST_ASSERT_EQUAL(0b01100, match(automaton, "/status"));
+    TEST_ASSERT_EQUAL(0b00100, match(automaton, "office/kitchen/temp"));
+}
+
+void test_empty_levels() {
+    TopicAutomaton<int> automaton;
+    automaton.insert("a//b", 0);
+    automaton.insert("a/+/b", 1);
+    automaton.insert("/", 2);
+    TEST_ASSERT_EQUAL(0b011, match(automaton, "a//b"));
+    TEST_ASSERT_EQUAL(0b010, match(automaton, "a/x/b"));
+    TEST_ASSERT_EQUAL(0b100, match(automaton, "/"));
+    TEST_ASSERT_EQUAL(0b000, match(automaton, "a/b"));
+}
+
+void test_rebuild_after_changes() {
+    const char * filters[] = {"dev/+/set", "dev/lamp/+", "dev/#"};
+    TopicAutomaton<int> automaton;
+    TEST_ASSERT_EQUAL(0b000, match(automaton, "dev/lamp/set"));
+
+    for (int i = 0; i < 3; ++i) {
+        automaton.insert(filters[i], i);
+    }
+    TEST_ASSERT_EQUAL(0b111, match(automaton, "dev/lamp/set"));
+
+    TEST_ASSERT_TRUE(automaton.remove(filters[1], 1));
+    TEST_ASSERT_FALSE(automaton.remove(filters[1], 1));
+    TEST_ASSERT_EQUAL(0b101, match(automaton, "dev/lamp/set"));
+
+    automaton.shrink();
+    TEST_ASSERT_EQUAL(0b101, match(automaton, "dev/lamp/set"));
+    TEST_ASSERT_EQUAL(2, automaton.size());
+}
+
+// Filters of 16 '+' levels, except for a literal "a" at the given level.  All
+// of them together need an automaton with over 100k states.
+static String exploding_filter(unsigned int level) {
+    String ret;
+    for (unsigned int i = 0; i < 16; ++i) {
+        ret += i ? "/" : "";
+        ret += (i == level) ? "a" : "+";
+    }
+    return ret;
+}
+
+void test_too_many_states() {
+    String filters[16];
+    TopicAutomaton<int> automaton(64);
+    for (int i = 0; i < 16; ++i) {
+        filters[i] = exploding_filter(i);
+        automaton.insert(filters[i].c_str(), i);
+    }
+
+    bool called = false;
+    TEST_ASSERT_FALSE(automaton.match("a/a/a/a/a/a/a/a/a/a/a/a/a/a/a/a",
+                                      [&called](int) { called = true; }));
+    TEST_ASSERT_FALSE(called);
+
+    for (int i = 2; i < 16; ++i) {
+        TEST_ASSERT_TRUE(automaton.remove(filters[i].c_str(), i));
+    }
+    TEST_ASSERT_TRUE(automaton.match("a/a/x/x/x/x/x/x/x/x/x/x/x/x/x/x",
+                                     [&called](int) { called = true; }));
+    TEST_ASSERT_TRUE(called);
+    TEST_ASSERT_EQUAL(0b11,
+                      match(automaton, "a/a/x/x/x/x/x/x/x/x/x/x/x/x/x/x"));
+}
+
+void test_subscriber_fallback() {
+    const char * topic = "a/a/a/a/a/a/a/a/a/a/a/a/a/a/a/a";
+    SubscribedMessageListener listener;
+
+    TEST_ASSERT_NOT_NULL(listener.subscribe(topic));
+    for (unsigned int i = 0; i < 16; ++i) {
+        TEST_ASSERT_NOT_NULL(listener.subscribe(exploding_filter(i)));
+    }
+
+    // the automaton is too big, the newest matching subscription still wins
+    TEST_ASSERT_EQUAL_STRING(exploding_filter(15).c_str(),
+                             listener.get_subscription_pattern(
+                                 listener.get_subscription(topic)));
+    TEST_ASSERT_EQUAL_STRING(exploding_filter(3).c_str(),
+                             listener.get_subscription_pattern(
+                                 listener.get_subscription(
+                                     "x/x/x/a/x/x/x/x/x/x/x/x/x/x/x/x")));
+    TEST_ASSERT_NULL(
+        listener.get_subscription("x/x/x/x/x/x/x/x/x/x/x/x/x/x/x/x"));
+
+    TEST_ASSERT_NOT_NULL(listener.subscribe("#"));
+    TEST_ASSERT_EQUAL_STRING("#", listener.get_subscription_pattern(
+                                      listener.get_subscription(topic)));
+
+    TEST_ASSERT_NOT_NULL(listener.subscribe(topic));
+    TEST_ASSERT_EQUAL_STRING(topic, listener.get_subscription_pattern(
+                                        listener.get_subscription(topic)));
+}
+
+void setup() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_literal_and_wildcards);
+    RUN_TEST(test_empty_levels);
+    RUN_TEST(test_rebuild_after_changes);
+    RUN_TEST(test_too_many_states);
+    RUN_TEST(test_subscriber_fallback);
+
+    UNITY_END();
+}
+
+void loop() {}
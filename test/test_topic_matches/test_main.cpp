@@ -3,7 +3,17 @@
 
 #include "PicoMQTT/subscriber.h"
 
+using PicoMQTT::PreparedTopic;
 using PicoMQTT::Subscriber;
+using PicoMQTT::TopicFilter;
+using PicoMQTT::TopicSegment;
+using PicoMQTT::TopicView;
+
+static bool compiled_matches(const char * topic_filter, const char * topic) {
+    TopicFilter filter(topic_filter);
+    filter.compile();
+    return filter.matches(PreparedTopic(topic));
+}
 
 void test_exact_match() {
     TEST_ASSERT_TRUE(Subscriber::topic_matches("home/livingroom/temp",
@@ -38,6 +48,75 @@ void test_plus_does_not_match_missing_level() {
     TEST_ASSERT_FALSE(Subscriber::topic_matches("home/+/temp", "home/temp"));
 }
 
+void test_plus_matches_empty_level() {
+    TEST_ASSERT_TRUE(Subscriber::topic_matches("home/+", "home/"));
+    TEST_ASSERT_TRUE(Subscriber::topic_matches("+/status", "/status"));
+    TEST_ASSERT_FALSE(Subscriber::topic_matches("home/+", "home"));
+}
+
+void test_compiled_filter() {
+    TEST_ASSERT_TRUE(compiled_matches("home/livingroom/temp",
+                                      "home/livingroom/temp"));
+    TEST_ASSERT_FALSE(compiled_matches("home/livingroom/temp",
+                                       "home/livingroom/humidity"));
+    TEST_ASSERT_FALSE(
+        compiled_matches("home/livingroom/temp", "home/livingroom"));
+    TEST_ASSERT_FALSE(compiled_matches("home/livingroom", "home/livingroomx"));
+    TEST_ASSERT_TRUE(compiled_matches("home/+/temp", "home/kitchen/temp"));
+    TEST_ASSERT_FALSE(
+        compiled_matches("home/+/temp", "home/kitchen/inside/temp"));
+    TEST_ASSERT_FALSE(compiled_matches("home/+/temp", "home/temp"));
+    TEST_ASSERT_TRUE(compiled_matches("+/+", "home/kitchen"));
+    TEST_ASSERT_TRUE(compiled_matches("+/status", "/status"));
+    TEST_ASSERT_TRUE(compiled_matches("home/#", "home/kitchen/temp"));
+    TEST_ASSERT_TRUE(compiled_matches("#", "home/kitchen/temp"));
+    TEST_ASSERT_TRUE(compiled_matches("home/#", "home"));
+    TEST_ASSERT_TRUE(compiled_matches("home/#", "home/"));
+    TEST_ASSERT_FALSE(compiled_matches("home/#", "homer"));
+    TEST_ASSERT_FALSE(compiled_matches("home/+/#", "home"));
+    TEST_ASSERT_FALSE(compiled_matches("office/#", "home/kitchen/temp"));
+    TEST_ASSERT_TRUE(compiled_matches("a/b/c/d/e/f/g/h/i/j/+",
+                                      "a/b/c/d/e/f/g/h/i/j/k"));
+    TEST_ASSERT_FALSE(compiled_matches("a/b/c/d/e/f/g/h/i/j/+",
+                                       "a/b/c/d/e/f/g/h/i/x/k"));
+}
+
+void test_captures() {
+    TopicSegment captures[2];
+    TEST_ASSERT_TRUE(Subscriber::topic_matches("home/+/+/#", "home/hall/fan/1",
+                                               captures, 2));
+    TEST_ASSERT_TRUE(captures[0] == "hall");
+    TEST_ASSERT_TRUE(captures[1] == "fan");
+
+    TEST_ASSERT_TRUE(
+        Subscriber::topic_matches("+/status", "/status", captures, 2));
+    TEST_ASSERT_EQUAL(0, captures[0].size);
+
+    // captures which don't fit are skipped
+    TEST_ASSERT_TRUE(Subscriber::topic_matches("+/+", "a/b", captures, 1));
+    TEST_ASSERT_TRUE(captures[0] == "a");
+}
+
+void test_topic_view() {
+    const char * topics[] = {"home/hall/fan", "home/", "", "//"};
+    const size_t levels[] = {3, 2, 1, 3};
+
+    for (size_t i = 0; i < 4; ++i) {
+        size_t count = 0;
+        for (const TopicSegment & level : TopicView(topics[i])) {
+            TEST_ASSERT_TRUE(Subscriber::get_topic_element(topics[i], count) ==
+                             level.to_string());
+            ++count;
+        }
+        TEST_ASSERT_EQUAL(levels[i], count);
+    }
+
+    TEST_ASSERT_TRUE(TopicView("home/hall/fan")[1] == "hall");
+    TEST_ASSERT_NULL(TopicView("home/hall/fan")[3].data);
+    TEST_ASSERT_EQUAL_STRING(
+        "", Subscriber::get_topic_element("home/hall/fan", 3).c_str());
+}
+
 void setup() {
     UNITY_BEGIN();
 
@@ -47,6 +126,10 @@ void setup() {
     RUN_TEST(test_hash_should_match_parent_topic_too);
     RUN_TEST(test_non_matching_prefix);
     RUN_TEST(test_plus_does_not_match_missing_level);
+    RUN_TEST(test_plus_matches_empty_level);
+    RUN_TEST(test_compiled_filter);
+    RUN_TEST(test_captures);
+    RUN_TEST(test_topic_view);
 
     UNITY_END();
 }
@@ -0,0 +1,107 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "PicoMQTT/topic_pattern.h"
+
+using PicoMQTT::TopicSegment;
+
+static_assert(PicoMQTT::topic_pattern_valid("a/+/b/#"), "");
+static_assert(PicoMQTT::topic_pattern_valid("+"), "");
+static_assert(PicoMQTT::topic_pattern_valid("/"), "");
+static_assert(PicoMQTT::topic_pattern_valid("+//+"), "");
+static_assert(!PicoMQTT::topic_pattern_valid(""), "");
+static_assert(!PicoMQTT::topic_pattern_valid("a+"), "");
+static_assert(!PicoMQTT::topic_pattern_valid("+a"), "");
+static_assert(!PicoMQTT::topic_pattern_valid("#/a"), "");
+static_assert(!PicoMQTT::topic_pattern_valid("a/b#"), "");
+static_assert(PicoMQTT::topic_pattern_wildcards("+/a/+/#") == 2, "");
+static_assert(PicoMQTT::topic_pattern_levels("+/a/+/#") == 4, "");
+
+static constexpr auto device_pattern = PICOMQTT_TOPIC_PATTERN("home/+/+/set");
+
+void test_captures() {
+    decltype(device_pattern)::Captures captures;
+    TEST_ASSERT_TRUE(device_pattern.match("home/kitchen/lamp/set", captures));
+    TEST_ASSERT_TRUE(captures[0] == "kitchen");
+    TEST_ASSERT_TRUE(captures[1] == "lamp");
+    TEST_ASSERT_EQUAL_STRING("lamp", captures[1].to_string().c_str());
+
+    TEST_ASSERT_TRUE(device_pattern.match("home//lamp/set", captures));
+    TEST_ASSERT_EQUAL(0, captures[0].size);
+    TEST_ASSERT_TRUE(captures[0] == "");
+
+    TEST_ASSERT_FALSE(device_pattern.match("home/kitchen/set", captures));
+    TEST_ASSERT_FALSE(device_pattern.match("home/kitchen/lamp/get", captures));
+    TEST_ASSERT_FALSE(
+        device_pattern.match("home/kitchen/lamp/set/x", captures));
+    TEST_ASSERT_FALSE(
+        device_pattern.match("office/kitchen/lamp/set", captures));
+}
+
+void test_multi_level_wildcard() {
+    constexpr auto pattern = PICOMQTT_TOPIC_PATTERN("+/status/#");
+    decltype(pattern)::Captures captures;
+    TEST_ASSERT_TRUE(pattern.match("lamp/status", captures));
+    TEST_ASSERT_TRUE(captures[0] == "lamp");
+    TEST_ASSERT_TRUE(pattern.match("fan/status/speed/1", captures));
+    TEST_ASSERT_TRUE(captures[0] == "fan");
+    TEST_ASSERT_FALSE(pattern.match("fan", captures));
+    TEST_ASSERT_FALSE(pattern.match("fan/speed", captures));
+}
+
+void test_literal() {
+    constexpr auto pattern = PICOMQTT_TOPIC_PATTERN("home/status");
+    decltype(pattern)::Captures captures;
+    TEST_ASSERT_TRUE(pattern.match("home/status", captures));
+    TEST_ASSERT_FALSE(pattern.match("home/statu", captures));
+    TEST_ASSERT_FALSE(pattern.match("home/status/", captures));
+    TEST_ASSERT_FALSE(pattern.match("home", captures));
+}
+
+void test_capture_matched_topic() {
+    const auto positions = device_pattern.get_wildcard_positions();
+    TEST_ASSERT_EQUAL(1, positions[0]);
+    TEST_ASSERT_EQUAL(2, positions[1]);
+
+    decltype(device_pattern)::Captures captures;
+    decltype(device_pattern)::capture("home/kitchen/lamp/set", positions,
+                                      captures);
+    TEST_ASSERT_TRUE(captures[0] == "kitchen");
+    TEST_ASSERT_TRUE(captures[1] == "lamp");
+
+    constexpr auto pattern = PICOMQTT_TOPIC_PATTERN("+/status/#");
+    decltype(pattern)::Captures status_captures;
+    decltype(pattern)::capture("fan/status/speed/1",
+                               pattern.get_wildcard_positions(),
+                               status_captures);
+    TEST_ASSERT_TRUE(status_captures[0] == "fan");
+}
+
+void test_invoke() {
+    decltype(device_pattern)::Captures captures;
+    TEST_ASSERT_TRUE(device_pattern.match("home/hall/fan/set", captures));
+
+    int result = 0;
+    PicoMQTT::TopicPatternCallback<2, int>::type callback =
+        [&result](TopicSegment room, TopicSegment device, int value) {
+            TEST_ASSERT_TRUE(room == "hall");
+            TEST_ASSERT_TRUE(device == "fan");
+            result = value;
+        };
+    decltype(device_pattern)::invoke(callback, captures, 7);
+    TEST_ASSERT_EQUAL(7, result);
+}
+
+void setup() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_captures);
+    RUN_TEST(test_multi_level_wildcard);
+    RUN_TEST(test_literal);
+    RUN_TEST(test_capture_matched_topic);
+    RUN_TEST(test_invoke);
+
+    UNITY_END();
+}
+
+void loop() {}
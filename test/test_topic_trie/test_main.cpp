@@ -0,0 +1,79 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "PicoMQTT/topic_trie.h"
+
+using PicoMQTT::TopicTrie;
+
+static unsigned int match(const TopicTrie<int> & trie, const char * topic) {
+    unsigned int ret = 0;
+    trie.match(topic, [&ret](int value) { ret |= 1 << value; });
+    return ret;
+}
+
+void test_exact_match() {
+    TopicTrie<int> trie;
+    trie.insert("home/livingroom/temp", 0);
+    trie.insert("home/livingroom/humidity", 1);
+    TEST_ASSERT_EQUAL(0b01, match(trie, "home/livingroom/temp"));
+    TEST_ASSERT_EQUAL(0b10, match(trie, "home/livingroom/humidity"));
+    TEST_ASSERT_EQUAL(0b00, match(trie, "home/livingroom"));
+    TEST_ASSERT_EQUAL(0b00, match(trie, "home/livingroom/temp/x"));
+}
+
+void test_wildcards() {
+    TopicTrie<int> trie;
+    trie.insert("home/+/temp", 0);
+    trie.insert("home/#", 1);
+    trie.insert("#", 2);
+    trie.insert("+/status", 3);
+    TEST_ASSERT_EQUAL(0b0111, match(trie, "home/kitchen/temp"));
+    TEST_ASSERT_EQUAL(0b0110, match(trie, "home/kitchen/inside/temp"));
+    TEST_ASSERT_EQUAL(0b0110, match(trie, "home"));
+    TEST_ASSERT_EQUAL(0b0110, match(trie, "home/"));
+    TEST_ASSERT_EQUAL(0b1100, match(trie, "office/status"));
+    TEST_ASSERT_EQUAL(0b1100, match(trie, "/status"));
+    TEST_ASSERT_EQUAL(0b0100, match(trie, "office/kitchen/temp"));
+}
+
+void test_multiple_values_per_filter() {
+    TopicTrie<int> trie;
+    trie.insert("home/+/temp", 0);
+    trie.insert("home/+/temp", 1);
+    TEST_ASSERT_EQUAL(0b11, match(trie, "home/kitchen/temp"));
+    TEST_ASSERT_TRUE(trie.remove("home/+/temp", 0));
+    TEST_ASSERT_EQUAL(0b10, match(trie, "home/kitchen/temp"));
+}
+
+void test_remove() {
+    TopicTrie<int> trie;
+    trie.insert("home/+/temp", 0);
+    trie.insert("home/#", 1);
+    trie.insert("home/kitchen", 2);
+
+    TEST_ASSERT_FALSE(trie.remove("home/+/temp", 1));
+    TEST_ASSERT_FALSE(trie.remove("home/+", 0));
+    TEST_ASSERT_FALSE(trie.remove("office/#", 1));
+
+    TEST_ASSERT_TRUE(trie.remove("home/+/temp", 0));
+    TEST_ASSERT_EQUAL(0b010, match(trie, "home/kitchen/temp"));
+    TEST_ASSERT_TRUE(trie.remove("home/#", 1));
+    TEST_ASSERT_EQUAL(0b000, match(trie, "home/kitchen/temp"));
+    TEST_ASSERT_EQUAL(0b100, match(trie, "home/kitchen"));
+    TEST_ASSERT_FALSE(trie.empty());
+    TEST_ASSERT_TRUE(trie.remove("home/kitchen", 2));
+    TEST_ASSERT_TRUE(trie.empty());
+}
+
+void setup() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_exact_match);
+    RUN_TEST(test_wildcards);
+    RUN_TEST(test_multiple_values_per_filter);
+    RUN_TEST(test_remove);
+
+    UNITY_END();
+}
+
+void loop() {}